@@ -0,0 +1,426 @@
+#include "archive.h"
+
+#include <QtCore/qstring.h>
+
+#include <algorithm>
+#include <filesystem>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+#ifdef IGAL_HAVE_ZLIB
+    #include <zlib.h>
+#endif
+
+#include "fsutils.h"
+#include "itemcolumns.h"
+#include "mappedfile.h"
+#include "mediatypes.h"
+
+const std::unordered_set<fs_str_t> archiveExtensions = {
+    FSSTR(".cbz"),
+    FSSTR(".zip")
+};
+
+const uint32_t ZIP_EOCD_SIGNATURE = 0x06054b50;
+const uint32_t ZIP64_EOCD_LOCATOR_SIGNATURE = 0x07064b50;
+const uint32_t ZIP64_EOCD_SIGNATURE = 0x06064b50;
+const uint32_t ZIP_CENTRAL_SIGNATURE = 0x02014b50;
+const uint32_t ZIP_LOCAL_SIGNATURE = 0x04034b50;
+
+const size_t ZIP_EOCD_SIZE = 22;
+const size_t ZIP_CENTRAL_HEADER_SIZE = 46;
+const size_t ZIP_LOCAL_HEADER_SIZE = 30;
+const size_t ZIP_MAX_COMMENT_SIZE = 0xFFFF;
+
+const uint16_t ZIP_METHOD_STORED = 0;
+const uint16_t ZIP_METHOD_DEFLATED = 8;
+const uint16_t ZIP_FLAG_ENCRYPTED = 0x0001;
+const uint16_t ZIP_EXTRA_ZIP64 = 0x0001;
+
+// Members are inflated into memory: refuse anything no image could need
+const uint64_t ZIP_MAX_MEMBER_SIZE = 1024ull * 1024 * 1024;
+
+// Deflate can't expand input by more than this: a larger stated size is a corrupt header
+const uint64_t ZIP_MAX_DEFLATE_RATIO = 1032;
+
+// Open archives kept around, so paging through one doesn't re-read its central directory
+const size_t OPEN_ARCHIVE_CACHE_SIZE = 4;
+
+struct ZipMember
+{
+    fs_str_t name;
+    uint16_t method = 0;
+    uint16_t flags = 0;
+    uint32_t dosTime = 0;
+    uint64_t compressedSize = 0;
+    uint64_t size = 0;
+    uint64_t localHeaderOffset = 0;
+};
+
+uint16_t readU16(const uint8_t* p)
+{
+    return uint16_t(p[0] | (p[1] << 8));
+}
+
+uint32_t readU32(const uint8_t* p)
+{
+    return uint32_t(readU16(p)) | (uint32_t(readU16(p + 2)) << 16);
+}
+
+uint64_t readU64(const uint8_t* p)
+{
+    return uint64_t(readU32(p)) | (uint64_t(readU32(p + 4)) << 32);
+}
+
+// Whether [offset, offset + length) lies within 'size' bytes. Both come from the
+// file, so the sum could wrap around.
+bool isInRange(uint64_t offset, uint64_t length, uint64_t size)
+{
+    return offset <= size && length <= size - offset;
+}
+
+// Read-only view of a ZIP file: the member table comes from the central directory,
+// member data is only touched when a member is read
+class ZipArchive
+{
+public:
+    explicit ZipArchive(const fs_str_t& path)
+        : file(path)
+    {
+        valid = file.isValid() && readCentralDirectory();
+    }
+
+    bool isValid() const { return valid; }
+    const std::vector<ZipMember>& getMembers() const { return members; }
+
+    const ZipMember* findMember(const fs_str_t& name) const
+    {
+        auto it = memberIndex.find(name);
+        return it != memberIndex.end() ? &members[it->second] : nullptr;
+    }
+
+    bool read(const ZipMember& member, ArchiveMemberData& result) const
+    {
+        const uint8_t* data = file.data();
+        size_t size = file.size();
+
+        uint64_t local = member.localHeaderOffset;
+        if ((member.flags & ZIP_FLAG_ENCRYPTED)
+            || member.size > ZIP_MAX_MEMBER_SIZE
+            || !isInRange(local, ZIP_LOCAL_HEADER_SIZE, size)
+            || readU32(data + local) != ZIP_LOCAL_SIGNATURE)
+        {
+            return false;
+        }
+
+        // The local header repeats name and extra field, possibly with different lengths
+        uint64_t begin = local + ZIP_LOCAL_HEADER_SIZE + readU16(data + local + 26) + readU16(data + local + 28);
+        if (!isInRange(begin, member.compressedSize, size))
+        {
+            return false;
+        }
+        const uint8_t* compressed = data + begin;
+
+        if (member.method == ZIP_METHOD_STORED)
+        {
+            file.adviseWillNeed(begin, member.compressedSize);
+            result.data = compressed;
+            result.size = static_cast<size_t>(member.compressedSize);
+            return true;
+        }
+
+#ifdef IGAL_HAVE_ZLIB
+        if (member.method == ZIP_METHOD_DEFLATED)
+        {
+            if (member.size > member.compressedSize * ZIP_MAX_DEFLATE_RATIO)
+            {
+                return false;
+            }
+            result.inflated.resize(static_cast<size_t>(member.size));
+
+            z_stream stream = {};
+            if (inflateInit2(&stream, -MAX_WBITS) != Z_OK)
+            {
+                return false;
+            }
+
+            // A single call: the whole input is mapped and the output size is known
+            stream.next_in = const_cast<Bytef*>(compressed);
+            stream.avail_in = static_cast<uInt>(member.compressedSize);
+            stream.next_out = result.inflated.data();
+            stream.avail_out = static_cast<uInt>(result.inflated.size());
+            int status = inflate(&stream, Z_FINISH);
+            inflateEnd(&stream);
+
+            if (status != Z_STREAM_END || stream.total_out != member.size)
+            {
+                return false;
+            }
+            result.data = result.inflated.data();
+            result.size = result.inflated.size();
+            return true;
+        }
+#endif
+
+        return false;
+    }
+
+private:
+    bool readCentralDirectory()
+    {
+        const uint8_t* data = file.data();
+        size_t size = file.size();
+        if (size < ZIP_EOCD_SIZE)
+        {
+            return false;
+        }
+
+        // The end of central directory record sits behind a variable-length comment
+        size_t eocd = size - ZIP_EOCD_SIZE;
+        size_t searchEnd = size > ZIP_EOCD_SIZE + ZIP_MAX_COMMENT_SIZE ? size - ZIP_EOCD_SIZE - ZIP_MAX_COMMENT_SIZE : 0;
+        while (readU32(data + eocd) != ZIP_EOCD_SIGNATURE)
+        {
+            if (eocd == searchEnd)
+            {
+                return false;
+            }
+            --eocd;
+        }
+
+        uint64_t entryCount = readU16(data + eocd + 10);
+        uint64_t cdOffset = readU32(data + eocd + 16);
+
+        // ZIP64: the real values are in a second record, found through a locator right before
+        if ((entryCount == 0xFFFF || cdOffset == 0xFFFFFFFF)
+            && eocd >= 20
+            && readU32(data + eocd - 20) == ZIP64_EOCD_LOCATOR_SIGNATURE)
+        {
+            uint64_t zip64Eocd = readU64(data + eocd - 20 + 8);
+            if (!isInRange(zip64Eocd, 56, size) || readU32(data + zip64Eocd) != ZIP64_EOCD_SIGNATURE)
+            {
+                return false;
+            }
+            entryCount = readU64(data + zip64Eocd + 32);
+            cdOffset = readU64(data + zip64Eocd + 48);
+        }
+
+        // The name table is all that's needed to list the archive
+        if (cdOffset < size)
+        {
+            file.adviseWillNeed(static_cast<size_t>(cdOffset), size - static_cast<size_t>(cdOffset));
+        }
+
+        uint64_t pos = cdOffset;
+        members.reserve(static_cast<size_t>(std::min<uint64_t>(entryCount, size / ZIP_CENTRAL_HEADER_SIZE)));
+        for (uint64_t i = 0; i < entryCount; ++i)
+        {
+            if (!isInRange(pos, ZIP_CENTRAL_HEADER_SIZE, size) || readU32(data + pos) != ZIP_CENTRAL_SIGNATURE)
+            {
+                return false;
+            }
+
+            const uint8_t* header = data + pos;
+            uint16_t nameLength = readU16(header + 28);
+            uint16_t extraLength = readU16(header + 30);
+            uint16_t commentLength = readU16(header + 32);
+            if (!isInRange(pos, ZIP_CENTRAL_HEADER_SIZE + nameLength + extraLength, size))
+            {
+                return false;
+            }
+
+            ZipMember member;
+            member.flags = readU16(header + 8);
+            member.method = readU16(header + 10);
+            member.dosTime = (uint32_t(readU16(header + 14)) << 16) | readU16(header + 12);
+            member.compressedSize = readU32(header + 20);
+            member.size = readU32(header + 24);
+            member.localHeaderOffset = readU32(header + 42);
+            readZip64Extra(header + ZIP_CENTRAL_HEADER_SIZE + nameLength, extraLength, member);
+
+            // Names are UTF-8 in practice, whatever the language encoding flag says
+            const char* name = reinterpret_cast<const char*>(header + ZIP_CENTRAL_HEADER_SIZE);
+            QString qname = QString::fromUtf8(name, nameLength);
+            if (!qname.endsWith('/'))
+            {
+                member.name = qstringToFsstr(qname.replace('/', fsstrToQstring(DIR_SEPARATOR)));
+                memberIndex.emplace(member.name, members.size());
+                members.push_back(std::move(member));
+            }
+
+            pos += ZIP_CENTRAL_HEADER_SIZE + nameLength + extraLength + commentLength;
+        }
+        return true;
+    }
+
+    // Sizes and offset too large for their 32-bit fields are stored in the ZIP64 extra field, in this order
+    static void readZip64Extra(const uint8_t* extra, size_t length, ZipMember& member)
+    {
+        size_t pos = 0;
+        while (pos + 4 <= length)
+        {
+            uint16_t id = readU16(extra + pos);
+            uint16_t fieldLength = readU16(extra + pos + 2);
+            if (pos + 4 + fieldLength > length)
+            {
+                return;
+            }
+
+            if (id == ZIP_EXTRA_ZIP64)
+            {
+                const uint8_t* field = extra + pos + 4;
+                const uint8_t* fieldEnd = field + fieldLength;
+                for (uint64_t* value : { &member.size, &member.compressedSize, &member.localHeaderOffset })
+                {
+                    if (*value == 0xFFFFFFFF && field + 8 <= fieldEnd)
+                    {
+                        *value = readU64(field);
+                        field += 8;
+                    }
+                }
+                return;
+            }
+            pos += 4 + fieldLength;
+        }
+    }
+
+    MappedFile file;
+    bool valid = false;
+    std::vector<ZipMember> members;
+    std::unordered_map<fs_str_t, size_t> memberIndex;
+};
+
+struct OpenArchive
+{
+    fs_str_t path;
+    long long mtime = 0;
+    std::shared_ptr<const ZipArchive> archive;
+};
+
+std::mutex openArchivesMux;
+std::list<OpenArchive> openArchives;
+
+// Shared, most recently used first. Reopened when the file changed on disk.
+std::shared_ptr<const ZipArchive> openZipArchive(const fs_str_t& path)
+{
+    std::error_code ec;
+    long long mtime = std::filesystem::last_write_time(path, ec).time_since_epoch().count();
+    if (ec)
+    {
+        return nullptr;
+    }
+
+    std::lock_guard lock(openArchivesMux);
+    auto it = std::find_if(openArchives.begin(), openArchives.end(), [&](const OpenArchive& a) { return a.path == path; });
+    if (it != openArchives.end() && it->mtime == mtime)
+    {
+        openArchives.splice(openArchives.begin(), openArchives, it);
+        return openArchives.front().archive;
+    }
+    if (it != openArchives.end())
+    {
+        openArchives.erase(it);
+    }
+
+    auto archive = std::make_shared<const ZipArchive>(path);
+    if (!archive->isValid())
+    {
+        return nullptr;
+    }
+
+    openArchives.push_front({ path, mtime, archive });
+    if (openArchives.size() > OPEN_ARCHIVE_CACHE_SIZE)
+    {
+        openArchives.pop_back();
+    }
+    return archive;
+}
+
+bool isArchive(const fs_str_t& path)
+{
+    std::error_code ec;
+    return archiveExtensions.count(getTargetExtension(path)) && std::filesystem::is_regular_file(path, ec);
+}
+
+bool splitArchivePath(const fs_str_t& path, fs_str_t& archivePath, fs_str_t& memberPath)
+{
+    // Only path components named like an archive are checked on disk
+    for (size_t pos = path.find(DIR_SEPARATOR); pos != fs_str_t::npos; pos = path.find(DIR_SEPARATOR, pos + 1))
+    {
+        fs_str_t prefix = path.substr(0, pos);
+        if (isArchive(prefix))
+        {
+            archivePath = std::move(prefix);
+            memberPath = path.substr(pos + 1);
+            return true;
+        }
+    }
+    return false;
+}
+
+fs_str_t getBrowseDirectory(const fs_str_t& target)
+{
+    fs_str_t archivePath;
+    fs_str_t memberPath;
+    if (splitArchivePath(target, archivePath, memberPath))
+    {
+        return archivePath + DIR_SEPARATOR;
+    }
+    return getTargetDirectory(target);
+}
+
+fs_str_t resolveArchiveTarget(const fs_str_t& target)
+{
+    if (!isArchive(target))
+    {
+        return target;
+    }
+
+    auto entries = scanArchive(target, [](const fs_str_t& name) { return imageExtensions.count(getTargetExtension(name)) > 0; });
+    auto first = std::min_element(entries.begin(), entries.end(), [](const ScanEntry& a, const ScanEntry& b)
+    {
+        return naturalCompare(a.name, b.name) < 0;
+    });
+    return first != entries.end() ? target + DIR_SEPARATOR + first->name : target;
+}
+
+std::vector<ScanEntry> scanArchive(const fs_str_t& archivePath, const std::function<bool(const fs_str_t&)>& filter)
+{
+    std::vector<ScanEntry> result;
+
+    auto archive = openZipArchive(archivePath);
+    if (!archive)
+    {
+        return result;
+    }
+
+    for (const auto& member : archive->getMembers())
+    {
+        if (filter(member.name))
+        {
+            // DOS date and time packed into one number still sort chronologically
+            result.push_back({ member.name, static_cast<long long>(member.dosTime), member.size });
+        }
+    }
+    return result;
+}
+
+bool readArchiveMember(const fs_str_t& path, ArchiveMemberData& result)
+{
+    fs_str_t archivePath;
+    fs_str_t memberPath;
+    if (!splitArchivePath(path, archivePath, memberPath))
+    {
+        return false;
+    }
+
+    auto archive = openZipArchive(archivePath);
+    const ZipMember* member = archive ? archive->findMember(memberPath) : nullptr;
+    if (!member || !archive->read(*member, result))
+    {
+        return false;
+    }
+
+    result.archive = std::move(archive);
+    return true;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <unordered_set>
+#include <vector>
+
+#include "defs.h"
+#include "dirscan.h"
+
+// ZIP/CBZ archives are browsed like directories. Their members are addressed
+// by virtual paths below the archive file ("/comics/set.cbz/ch1/001.jpg") and
+// read straight out of a memory mapping of the archive: stored members without
+// any copy, deflated ones inflated into memory. Nothing is extracted to disk.
+
+extern const std::unordered_set<fs_str_t> archiveExtensions;
+
+bool isArchive(const fs_str_t& path);
+
+// Splits a virtual path into the archive file and the member path inside it
+// (empty for the archive root). False if 'path' doesn't point into an archive.
+bool splitArchivePath(const fs_str_t& path, fs_str_t& archivePath, fs_str_t& memberPath);
+
+// Directory whose items are browsed around 'target': the archive root for archive members
+fs_str_t getBrowseDirectory(const fs_str_t& target);
+
+// For an archive, the virtual path of its first image (by name). Other targets are returned as is.
+fs_str_t resolveArchiveTarget(const fs_str_t& target);
+
+// Lists the members of an archive from its central directory, like scanDirectory().
+// Names are relative to the archive root; no member data is read.
+std::vector<ScanEntry> scanArchive(const fs_str_t& archivePath, const std::function<bool(const fs_str_t&)>& filter);
+
+class ZipArchive;
+
+// Contents of a single member. 'data' points into the archive mapping for
+// stored members, or into 'inflated' for deflated ones.
+struct ArchiveMemberData
+{
+    std::shared_ptr<const ZipArchive> archive;
+    std::vector<uint8_t> inflated;
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+};
+
+// False if 'path' isn't an archive member, or it can't be read
+bool readArchiveMember(const fs_str_t& path, ArchiveMemberData& result);
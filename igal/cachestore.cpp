@@ -0,0 +1,263 @@
+#include "cachestore.h"
+
+#include <QtCore/qcoreapplication.h>
+#include <QtCore/qdir.h>
+#include <QtCore/qstandardpaths.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <vector>
+
+#include "fsutils.h"
+#include "hash.h"
+
+const size_t CONTENT_KEY_SAMPLE_SIZE = 64 * 1024;
+const uint64_t CACHE_DEFAULT_SIZE_LIMIT_MB = 2048;
+const fs_str_t CACHE_TEMP_MARKER = FSSTR(".tmp-");
+
+// Temp files this old belong to a writer that died, younger ones may still be in progress
+const auto CACHE_STALE_TEMP_AGE = std::chrono::hours(1);
+
+// Eviction frees this fraction of the cap beyond it, so that the next commits don't cross it again right away
+const uint64_t CACHE_EVICT_HEADROOM_DIVISOR = 10;
+
+// Entries other processes commit are only seen by a scan: one runs at least this often
+const auto CACHE_RESCAN_INTERVAL = std::chrono::minutes(10);
+
+// Size of the cache as of the last scan, plus what this process committed since
+struct CacheUsage
+{
+    std::mutex mux;
+    bool scanned = false;
+    uint64_t bytes = 0;
+    std::chrono::steady_clock::time_point scanTime;
+};
+
+CacheUsage& getCacheUsage()
+{
+    static CacheUsage usage;
+    return usage;
+}
+
+// Counts a committed entry in. True if the cache needs a scan: over the cap, or not scanned lately.
+bool addCacheUsage(uint64_t addedBytes, uint64_t replacedBytes, uint64_t maxBytes)
+{
+    CacheUsage& usage = getCacheUsage();
+    std::lock_guard lock(usage.mux);
+    if (!usage.scanned || std::chrono::steady_clock::now() - usage.scanTime > CACHE_RESCAN_INTERVAL)
+    {
+        return true;
+    }
+
+    usage.bytes += addedBytes;
+    usage.bytes -= std::min(usage.bytes, replacedBytes);
+    return usage.bytes > maxBytes;
+}
+
+void setCacheUsage(uint64_t bytes)
+{
+    CacheUsage& usage = getCacheUsage();
+    std::lock_guard lock(usage.mux);
+    usage.scanned = true;
+    usage.bytes = bytes;
+    usage.scanTime = std::chrono::steady_clock::now();
+}
+
+fs_str_t getCacheRoot()
+{
+    static const fs_str_t root = []()
+    {
+        QString base = QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation);
+        fs_str_t result = qstringToFsstr(QDir::toNativeSeparators(base)) + DIR_SEPARATOR + FSSTR("igal");
+
+        std::error_code ec;
+        std::filesystem::create_directories(result, ec);
+        return result;
+    }();
+    return root;
+}
+
+std::string getContentKey(const fs_str_t& path)
+{
+    std::error_code ec;
+    uint64_t size = std::filesystem::file_size(path, ec);
+    if (ec)
+    {
+        return std::string();
+    }
+    long long mtime = std::filesystem::last_write_time(path, ec).time_since_epoch().count();
+    if (ec)
+    {
+        return std::string();
+    }
+
+    std::vector<char> buffer(sizeof(size) + sizeof(mtime) + CONTENT_KEY_SAMPLE_SIZE * 2);
+    std::memcpy(buffer.data(), &size, sizeof(size));
+    std::memcpy(buffer.data() + sizeof(size), &mtime, sizeof(mtime));
+    size_t used = sizeof(size) + sizeof(mtime);
+
+    std::ifstream ifs(path, std::ios::binary);
+    if (!ifs)
+    {
+        return std::string();
+    }
+
+    ifs.read(buffer.data() + used, CONTENT_KEY_SAMPLE_SIZE);
+    used += ifs.gcount();
+
+    if (size > CONTENT_KEY_SAMPLE_SIZE)
+    {
+        ifs.clear();
+        ifs.seekg(std::max<uint64_t>(CONTENT_KEY_SAMPLE_SIZE, size - CONTENT_KEY_SAMPLE_SIZE));
+        ifs.read(buffer.data() + used, CONTENT_KEY_SAMPLE_SIZE);
+        used += ifs.gcount();
+    }
+
+    char hex[17];
+    std::snprintf(hex, sizeof(hex), "%016llx", static_cast<unsigned long long>(xxHash64(buffer.data(), used)));
+    return std::string(hex);
+}
+
+fs_str_t getCachePath(const std::string& key, const fs_str_t& suffix)
+{
+    return getCacheRoot() + DIR_SEPARATOR + fs_str_t(key.begin(), key.end()) + suffix;
+}
+
+bool useCacheFile(const fs_str_t& path)
+{
+    std::error_code ec;
+    if (!std::filesystem::is_regular_file(path, ec))
+    {
+        return false;
+    }
+
+    // The modification time doubles as last-use time for LRU eviction (atime is often disabled)
+    std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), ec);
+    return true;
+}
+
+fs_str_t getCacheTempPath(const fs_str_t& path)
+{
+    static std::atomic<unsigned> counter = 0;
+
+    std::string unique = std::to_string(QCoreApplication::applicationPid()) + "-" + std::to_string(counter++);
+
+    std::filesystem::path fsPath(path);
+    return fs_str_t(fsPath.parent_path().native())
+        + DIR_SEPARATOR
+        + fs_str_t(fsPath.stem().native())
+        + CACHE_TEMP_MARKER
+        + fs_str_t(unique.begin(), unique.end())
+        + fs_str_t(fsPath.extension().native());
+}
+
+bool commitCacheFile(const fs_str_t& tempPath, const fs_str_t& path)
+{
+    std::error_code ec;
+    uint64_t size = std::filesystem::file_size(tempPath, ec);
+    if (size == 0 || ec)
+    {
+        std::filesystem::remove(tempPath, ec);
+        return false;
+    }
+
+    std::error_code replacedEc;
+    uint64_t replacedSize = std::filesystem::file_size(path, replacedEc);
+
+    // Readers only ever see complete files: the rename replaces the entry in one step
+    std::filesystem::rename(tempPath, path, ec);
+    if (ec)
+    {
+        std::filesystem::remove(tempPath, ec);
+        return false;
+    }
+
+    // The directory is only enumerated once the cap is crossed
+    uint64_t maxBytes = getCacheSizeLimit();
+    if (addCacheUsage(size, replacedEc ? 0 : replacedSize, maxBytes))
+    {
+        evictCache(maxBytes);
+    }
+    return true;
+}
+
+uint64_t getCacheSizeLimit()
+{
+    bool ok = false;
+    int limitMb = qEnvironmentVariableIntValue("IGAL_CACHE_SIZE_MB", &ok);
+    uint64_t result = (ok && limitMb > 0) ? static_cast<uint64_t>(limitMb) : CACHE_DEFAULT_SIZE_LIMIT_MB;
+    return result * 1024 * 1024;
+}
+
+void evictCache(uint64_t maxBytes)
+{
+    namespace stdfs = std::filesystem;
+
+    struct CacheEntry
+    {
+        stdfs::file_time_type lastUse;
+        uint64_t size;
+        stdfs::path path;
+    };
+
+    std::vector<CacheEntry> entries;
+    uint64_t totalSize = 0;
+    auto now = stdfs::file_time_type::clock::now();
+
+    std::error_code ec;
+    for (const auto& f : stdfs::directory_iterator(getCacheRoot(), ec))
+    {
+        std::error_code entryEc;
+        if (!f.is_regular_file(entryEc))
+        {
+            continue;
+        }
+
+        auto lastUse = f.last_write_time(entryEc);
+        uint64_t size = f.file_size(entryEc);
+        if (entryEc)
+        {
+            continue;
+        }
+
+        if (fs_str_t(f.path().filename().native()).find(CACHE_TEMP_MARKER) != fs_str_t::npos)
+        {
+            if (now - lastUse > CACHE_STALE_TEMP_AGE)
+            {
+                stdfs::remove(f.path(), entryEc);
+            }
+            continue;
+        }
+
+        entries.push_back({ lastUse, size, f.path() });
+        totalSize += size;
+    }
+
+    if (totalSize <= maxBytes)
+    {
+        setCacheUsage(totalSize);
+        return;
+    }
+
+    std::sort(entries.begin(), entries.end(), [](const CacheEntry& a, const CacheEntry& b) { return a.lastUse < b.lastUse; });
+
+    uint64_t targetSize = maxBytes - maxBytes / CACHE_EVICT_HEADROOM_DIVISOR;
+    for (const auto& entry : entries)
+    {
+        if (totalSize <= targetSize)
+        {
+            break;
+        }
+        if (stdfs::remove(entry.path, ec))
+        {
+            totalSize -= entry.size;
+        }
+    }
+    setCacheUsage(totalSize);
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "defs.h"
+
+// Content-addressed cache shared by every igal process of the user, under
+// $XDG_CACHE_HOME/igal (or the platform equivalent). Entries are named after a
+// content key of their source, so an edited source simply gets a new entry and
+// stale ones age out through LRU eviction once the size cap is reached.
+
+fs_str_t getCacheRoot();
+
+// Fast identity of a file's content: xxHash64 of size, mtime and the first/last 64 KiB.
+// Empty if the file can't be read.
+std::string getContentKey(const fs_str_t& path);
+
+fs_str_t getCachePath(const std::string& key, const fs_str_t& suffix);
+
+// True if the entry exists; marks it as recently used
+bool useCacheFile(const fs_str_t& path);
+
+// Unique scratch path to write an entry to before committing it.
+// The suffix of 'path' is kept, so tools can still infer the file format.
+fs_str_t getCacheTempPath(const fs_str_t& path);
+
+// Atomically moves a finished temp file into place, then enforces the size cap. The
+// cache size is tracked in memory: the directory is only scanned when the cap is
+// crossed, and every few minutes to count in what other processes wrote.
+bool commitCacheFile(const fs_str_t& tempPath, const fs_str_t& path);
+
+// Cap from IGAL_CACHE_SIZE_MB, 2 GiB by default
+uint64_t getCacheSizeLimit();
+
+// Deletes least recently used entries until the cache fits in 'maxBytes', with some room to spare
+void evictCache(uint64_t maxBytes);
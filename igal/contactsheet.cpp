@@ -0,0 +1,287 @@
+#include "contactsheet.h"
+
+#include <QtCore/qelapsedtimer.h>
+
+#include <QtGui/qfont.h>
+#include <QtGui/qfontmetrics.h>
+#include <QtGui/qimagewriter.h>
+#include <QtGui/qpainter.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "archive.h"
+#include "frame.h"
+#include "fsutils.h"
+#include "itemcolumns.h"
+#include "mediatypes.h"
+#include "videopreview.h"
+
+const int SHEET_PADDING = 8;
+const int SHEET_LABEL_HEIGHT = 18;
+const int SHEET_LABEL_PIXEL_SIZE = 12;
+const int SHEET_JPEG_QUALITY = 90;
+
+const int SHEET_MIN_TILE_SIZE = 16;
+const int SHEET_MAX_TILE_SIZE = 4096;
+
+// Keeps a page well inside the JPEG size limit and a few hundred MB of pixels
+const int SHEET_MAX_SIDE = 16384;
+
+const QColor SHEET_BACKGROUND(0x20, 0x20, 0x20);
+const QColor SHEET_LABEL_COLOR(0xEE, 0xEE, 0xEE);
+
+// How many tiles are rendered between progress reports
+const size_t SHEET_PROGRESS_INTERVAL = 64;
+
+QSize getCellSize(const ContactSheetLayout& layout)
+{
+    return QSize(layout.tileSize + SHEET_PADDING, layout.tileSize + SHEET_LABEL_HEIGHT + SHEET_PADDING);
+}
+
+bool ContactSheetLayout::isValid() const
+{
+    if (columns <= 0 || rows <= 0 || tileSize < SHEET_MIN_TILE_SIZE || tileSize > SHEET_MAX_TILE_SIZE)
+    {
+        return false;
+    }
+
+    QSize cell = getCellSize(*this);
+    return static_cast<long long>(columns) * cell.width() + SHEET_PADDING <= SHEET_MAX_SIDE
+        && static_cast<long long>(rows) * cell.height() + SHEET_PADDING <= SHEET_MAX_SIDE;
+}
+
+size_t getContactSheetCount(size_t itemCount, const ContactSheetLayout& layout)
+{
+    size_t perPage = static_cast<size_t>(layout.columns) * layout.rows;
+    return (itemCount + perPage - 1) / perPage;
+}
+
+fs_str_t getContactSheetPath(const fs_str_t& outputPath, size_t page, size_t pageCount)
+{
+    if (pageCount <= 1)
+    {
+        return outputPath;
+    }
+
+    int digits = std::max(3, static_cast<int>(QString::number(pageCount).size()));
+    QString number = QString::number(page + 1).rightJustified(digits, '0');
+
+    std::filesystem::path path(outputPath);
+    fs_str_t name = path.stem().native() + FSSTR("-") + qstringToFsstr(number) + path.extension().native();
+    return path.replace_filename(name).native();
+}
+
+// The item scaled and turned to fit the tile, or a null image if it can't be shown
+QImage loadTile(const fs_str_t& path, int tileSize)
+{
+    QSize size(tileSize, tileSize);
+
+    FramePtr frame;
+    if (isVideo(path))
+    {
+        auto preview = loadVideoPreview(path);
+        if (preview && preview->isValid())
+        {
+            frame = makeFrame(preview->getFrame(preview->intervalMs * (preview->frameCount / 2)));
+        }
+    }
+    else
+    {
+        frame = decodeFrame(path, size);
+    }
+
+    return frame ? scaleFrameForDisplay(*frame, size) : QImage();
+}
+
+void renderCell(QImage& cell, const QImage& tile, const QString& name, const QFont& font, int tileSize)
+{
+    cell.fill(SHEET_BACKGROUND);
+
+    QPainter painter(&cell);
+    if (!tile.isNull())
+    {
+        painter.drawImage((tileSize - tile.width()) / 2, (tileSize - tile.height()) / 2, tile);
+    }
+
+    painter.setFont(font);
+    painter.setPen(SHEET_LABEL_COLOR);
+    QRect labelRect(0, tileSize, tileSize, SHEET_LABEL_HEIGHT);
+    painter.drawText(labelRect, Qt::AlignCenter, QFontMetrics(font).elidedText(name, Qt::ElideMiddle, tileSize));
+}
+
+// Renders items [first, first + count) onto one page, a tile per core at a time
+QImage renderPage(
+    const ItemList& items,
+    size_t first,
+    size_t count,
+    const ContactSheetLayout& layout,
+    std::atomic<size_t>& done,
+    const std::function<void(size_t done, size_t total)>& onProgress)
+{
+    QSize cellSize = getCellSize(layout);
+    int usedRows = static_cast<int>((count + layout.columns - 1) / layout.columns);
+
+    QImage page(layout.columns * cellSize.width() + SHEET_PADDING, usedRows * cellSize.height() + SHEET_PADDING, QImage::Format_RGB32);
+    page.fill(SHEET_BACKGROUND);
+
+    // Cells are disjoint: workers copy their rows in without locking
+    uchar* pageBits = page.bits();
+    size_t pageStride = static_cast<size_t>(page.bytesPerLine());
+    size_t cellRowBytes = static_cast<size_t>(cellSize.width() - SHEET_PADDING) * 4;
+
+    std::atomic<size_t> next = 0;
+    size_t threadCount = std::clamp<size_t>(std::thread::hardware_concurrency(), 1, count);
+
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < threadCount; ++t)
+    {
+        threads.emplace_back([&]()
+        {
+            QFont font;
+            font.setPixelSize(SHEET_LABEL_PIXEL_SIZE);
+            QImage cell(cellSize.width() - SHEET_PADDING, cellSize.height() - SHEET_PADDING, QImage::Format_RGB32);
+
+            for (size_t i = next++; i < count; i = next++)
+            {
+                size_t item = first + i;
+                QImage tile = loadTile(items[item], layout.tileSize);
+                renderCell(cell, tile, fsstrToQstring(fs_str_t(items.getName(item))), font, layout.tileSize);
+
+                int x = SHEET_PADDING + static_cast<int>(i % layout.columns) * cellSize.width();
+                int y = SHEET_PADDING + static_cast<int>(i / layout.columns) * cellSize.height();
+                for (int row = 0; row < cell.height(); ++row)
+                {
+                    std::memcpy(pageBits + (y + row) * pageStride + x * 4, cell.constScanLine(row), cellRowBytes);
+                }
+
+                size_t doneCount = ++done;
+                if (onProgress && doneCount % SHEET_PROGRESS_INTERVAL == 0)
+                {
+                    onProgress(doneCount, items.size());
+                }
+            }
+        });
+    }
+
+    for (auto& t : threads)
+    {
+        t.join();
+    }
+    return page;
+}
+
+bool writeSheet(const QImage& page, const fs_str_t& path)
+{
+    bool isPng = getTargetExtension(path) == FSSTR(".png");
+
+    QImageWriter writer(fsstrToQstring(path), isPng ? "png" : "jpg");
+    if (!isPng)
+    {
+        writer.setQuality(SHEET_JPEG_QUALITY);
+    }
+    return writer.write(page);
+}
+
+size_t exportContactSheets(
+    const ItemList& items,
+    const fs_str_t& outputPath,
+    const ContactSheetLayout& layout,
+    const std::function<void(size_t done, size_t total)>& onProgress)
+{
+    size_t perPage = static_cast<size_t>(layout.columns) * layout.rows;
+    size_t pageCount = getContactSheetCount(items.size(), layout);
+
+    std::atomic<size_t> done = 0;
+    size_t written = 0;
+    bool failed = false;
+
+    // A page is encoded while the next one renders: at most two are held at once
+    std::thread writer;
+    for (size_t page = 0; page < pageCount; ++page)
+    {
+        size_t first = page * perPage;
+        QImage sheet = renderPage(items, first, std::min(perPage, items.size() - first), layout, done, onProgress);
+
+        if (writer.joinable())
+        {
+            writer.join();
+        }
+        if (failed)
+        {
+            break;
+        }
+
+        writer = std::thread([&, sheet = std::move(sheet), path = getContactSheetPath(outputPath, page, pageCount)]()
+        {
+            if (writeSheet(sheet, path))
+            {
+                ++written;
+            }
+            else
+            {
+                failed = true;
+            }
+        });
+    }
+
+    if (writer.joinable())
+    {
+        writer.join();
+    }
+
+    if (onProgress)
+    {
+        onProgress(done, items.size());
+    }
+    return written;
+}
+
+int runContactSheetMode(const fs_str_t& target, const fs_str_t& outputPath, const ContactSheetLayout& layout)
+{
+    fs_str_t ext = getTargetExtension(outputPath);
+    if (ext != FSSTR(".jpg") && ext != FSSTR(".jpeg") && ext != FSSTR(".png"))
+    {
+        std::cerr << "Contact sheets are written as .jpg or .png files\n";
+        return 1;
+    }
+
+    if (!layout.isValid())
+    {
+        std::cerr << "Invalid contact sheet layout\n";
+        return 1;
+    }
+
+    std::error_code ec;
+    fs_str_t dir = std::filesystem::is_directory(target, ec) ? target : getBrowseDirectory(resolveArchiveTarget(target));
+
+    ItemList items;
+    ItemColumns columns;
+    scanMediaItems(dir, items, columns);
+    applyItemOrder(items, columns, getSortedItemOrder(items, columns, SortOrder::Name));
+    if (items.empty())
+    {
+        std::cerr << "No media items in " << qPrintable(fsstrToQstring(dir)) << "\n";
+        return 1;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+
+    size_t pageCount = getContactSheetCount(items.size(), layout);
+    size_t written = exportContactSheets(items, outputPath, layout, [](size_t done, size_t total)
+    {
+        std::cout << "\rRendered " << done << "/" << total << std::flush;
+    });
+
+    std::cout << "\nWrote " << written << " of " << pageCount << " contact sheets for "
+              << items.size() << " items, in "
+              << timer.elapsed() / 1000.0 << " s\n";
+
+    return written == pageCount ? 0 : 1;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <functional>
+
+#include "defs.h"
+#include "itemlist.h"
+
+// Grid of a contact sheet page: 'columns' x 'rows' cells, each holding an item
+// scaled to fit 'tileSize' x 'tileSize' pixels above its filename
+struct ContactSheetLayout
+{
+    int columns = 6;
+    int rows = 8;
+    int tileSize = 256;
+
+    bool isValid() const;
+};
+
+// Pages needed for 'itemCount' items
+size_t getContactSheetCount(size_t itemCount, const ContactSheetLayout& layout);
+
+// Path page 'page' is written to: 'outputPath' itself for a single page, else
+// numbered before the extension (sheet.jpg -> sheet-001.jpg, sheet-002.jpg...)
+fs_str_t getContactSheetPath(const fs_str_t& outputPath, size_t page, size_t pageCount);
+
+// Renders the items, in list order, onto contact sheet pages and writes them as
+// JPEG or PNG (by the extension of 'outputPath'). Tiles are decoded on every
+// core at reduced resolution, through the pixel cache; videos use a frame of
+// their cached seek preview. Pages are rendered and written one after the
+// other, so memory use depends on the layout, not on the number of items.
+// Returns how many pages were written: fewer than getContactSheetCount() if
+// one could not be.
+size_t exportContactSheets(
+    const ItemList& items,
+    const fs_str_t& outputPath,
+    const ContactSheetLayout& layout,
+    const std::function<void(size_t done, size_t total)>& onProgress);
+
+// Headless export (igal --contact-sheet <output> <dir>): the items of the
+// directory (or archive) by name. Prints a summary, returns the process exit code.
+int runContactSheetMode(const fs_str_t& target, const fs_str_t& outputPath, const ContactSheetLayout& layout);
@@ -0,0 +1,807 @@
+#include "decoder.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <csetjmp>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "archive.h"
+#include "exif.h"
+#include "fsutils.h"
+#include "mappedfile.h"
+#include "mediatypes.h"
+
+#ifdef IGAL_HAVE_LIBJPEG
+    #include <jpeglib.h>
+#endif
+
+#ifdef IGAL_HAVE_LIBWEBP
+    #include <webp/decode.h>
+#endif
+
+#ifdef IGAL_HAVE_LIBTIFF
+    #include <tiffio.h>
+#endif
+
+const QString DECODE_SCALE_KEY = "igal-decode-scale";
+const QString DECODE_ORIENTATION_KEY = "igal-orientation";
+
+// Factor the image has to be scaled by to fit (keeping aspect ratio) into 'targetSize'
+double getFitScale(int width, int height, const QSize& targetSize)
+{
+    if (targetSize.isEmpty() || width <= 0 || height <= 0)
+    {
+        return 1.0;
+    }
+
+    double scale = std::min(double(targetSize.width()) / width, double(targetSize.height()) / height);
+    return std::min(scale, 1.0);
+}
+
+bool isJpegData(const uint8_t* data, size_t size)
+{
+    return size >= 3 && data[0] == 0xFF && data[1] == 0xD8 && data[2] == 0xFF;
+}
+
+bool isWebpData(const uint8_t* data, size_t size)
+{
+    return size >= 12
+        && std::equal(data, data + 4, "RIFF")
+        && std::equal(data + 8, data + 12, "WEBP");
+}
+
+bool isTiffData(const uint8_t* data, size_t size)
+{
+    // Classic TIFF (42) or BigTIFF (43), in either byte order
+    return size >= 4
+        && ((data[0] == 'I' && data[1] == 'I' && (data[2] == 42 || data[2] == 43) && data[3] == 0)
+            || (data[0] == 'M' && data[1] == 'M' && data[2] == 0 && (data[3] == 42 || data[3] == 43)));
+}
+
+#ifdef IGAL_HAVE_LIBJPEG
+
+struct JpegErrorManager
+{
+    jpeg_error_mgr base;
+    std::jmp_buf jump;
+};
+
+void jpegErrorExit(j_common_ptr info)
+{
+    auto* err = reinterpret_cast<JpegErrorManager*>(info->err);
+    std::longjmp(err->jump, 1);
+}
+
+// Largest DCT scaling denominator (1, 2, 4 or 8) that still covers the fitted target size
+unsigned int getJpegScaleDenom(int width, int height, const QSize& targetSize)
+{
+    double scale = getFitScale(width, height, targetSize);
+
+    unsigned int denom = 1;
+    while (denom < 8 && scale * denom * 2 <= 1.0)
+    {
+        denom *= 2;
+    }
+    return denom;
+}
+
+// The libjpeg calls, any of which may longjmp back here on corrupt data. Locals of a
+// function calling setjmp that change in between are indeterminate after the jump,
+// so everything that outlives it belongs to the caller.
+bool readJpeg(jpeg_decompress_struct& info, JpegErrorManager& err, const uint8_t* data, size_t size, const QSize& targetSize,
+    QImage& result, std::vector<JSAMPROW>& rows)
+{
+    if (setjmp(err.jump))
+    {
+        return false;
+    }
+
+    jpeg_create_decompress(&info);
+    jpeg_mem_src(&info, const_cast<unsigned char*>(data), static_cast<unsigned long>(size));
+    jpeg_read_header(&info, TRUE);
+
+    // Leave CMYK/YCCK to Qt, which knows how to invert Adobe CMYK
+    if (info.jpeg_color_space == JCS_CMYK || info.jpeg_color_space == JCS_YCCK)
+    {
+        return false;
+    }
+
+    info.scale_num = 1;
+    info.scale_denom = getJpegScaleDenom(info.image_width, info.image_height, targetSize);
+
+    // Convert straight into QImage's native 32-bit layout (SIMD accelerated on libjpeg-turbo)
+#ifdef JCS_EXTENSIONS
+    info.out_color_space = Q_BYTE_ORDER == Q_LITTLE_ENDIAN ? JCS_EXT_BGRX : JCS_EXT_XRGB;
+    QImage::Format format = QImage::Format_RGB32;
+#else
+    info.out_color_space = JCS_RGB;
+    QImage::Format format = QImage::Format_RGB888;
+#endif
+
+    jpeg_start_decompress(&info);
+
+    result = QImage(info.output_width, info.output_height, format);
+    if (result.isNull())
+    {
+        return false;
+    }
+
+    rows.resize(info.output_height);
+    for (size_t y = 0; y < rows.size(); ++y)
+    {
+        rows[y] = result.scanLine(static_cast<int>(y));
+    }
+
+    while (info.output_scanline < info.output_height)
+    {
+        jpeg_read_scanlines(&info, rows.data() + info.output_scanline, info.output_height - info.output_scanline);
+    }
+
+    if (info.scale_denom > 1)
+    {
+        result.setText(DECODE_SCALE_KEY, QString::number(info.scale_denom));
+    }
+
+    jpeg_finish_decompress(&info);
+    return true;
+}
+
+QImage decodeJpeg(const uint8_t* data, size_t size, const QSize& targetSize)
+{
+    jpeg_decompress_struct info = {};
+    JpegErrorManager err;
+    info.err = jpeg_std_error(&err.base);
+    err.base.error_exit = jpegErrorExit;
+
+    QImage result;
+    std::vector<JSAMPROW> rows;
+    bool ok = readJpeg(info, err, data, size, targetSize, result, rows);
+    jpeg_destroy_decompress(&info);
+
+    return ok ? result : QImage();
+}
+
+#endif
+
+    jpeg_start_decompress(&info);
+
+    result = QImage(info.output_width, info.output_height, format);
+    if (result.isNull())
+    {
+        jpeg_destroy_decompress(&info);
+        return QImage();
+    }
+
+    rows.resize(info.output_height);
+    for (size_t y = 0; y < rows.size(); ++y)
+    {
+        rows[y] = result.scanLine(static_cast<int>(y));
+    }
+
+    while (info.output_scanline < info.output_height)
+    {
+        jpeg_read_scanlines(&info, rows.data() + info.output_scanline, info.output_height - info.output_scanline);
+    }
+
+    if (info.scale_denom > 1)
+    {
+        result.setText(DECODE_SCALE_KEY, QString::number(info.scale_denom));
+    }
+
+    jpeg_finish_decompress(&info);
+    jpeg_destroy_decompress(&info);
+
+    return result;
+}
+
+#endif
+
+#ifdef IGAL_HAVE_LIBWEBP
+
+QImage decodeWebp(const uint8_t* data, size_t size, const QSize& targetSize)
+{
+    WebPDecoderConfig config;
+    if (!WebPInitDecoderConfig(&config)
+        || WebPGetFeatures(data, size, &config.input) != VP8_STATUS_OK
+        || config.input.has_animation)
+    {
+        return QImage();
+    }
+
+    int width = config.input.width;
+    int height = config.input.height;
+
+    double scale = getFitScale(width, height, targetSize);
+    if (scale < 1.0)
+    {
+        width = std::max(1, int(std::ceil(width * scale)));
+        height = std::max(1, int(std::ceil(height * scale)));
+
+        config.options.use_scaling = 1;
+        config.options.scaled_width = width;
+        config.options.scaled_height = height;
+    }
+
+    QImage result(width, height, config.input.has_alpha ? QImage::Format_ARGB32_Premultiplied : QImage::Format_RGB32);
+    if (result.isNull())
+    {
+        return QImage();
+    }
+
+    // Lets libwebp filter and decode the alpha plane on separate threads
+    config.options.use_threads = 1;
+
+    // Decode in place into the QImage buffer, premultiplied, in QImage's native byte order
+    config.output.colorspace = Q_BYTE_ORDER == Q_LITTLE_ENDIAN ? MODE_bgrA : MODE_Argb;
+    config.output.is_external_memory = 1;
+    config.output.u.RGBA.rgba = result.bits();
+    config.output.u.RGBA.stride = result.bytesPerLine();
+    config.output.u.RGBA.size = result.sizeInBytes();
+
+    bool ok = WebPDecode(data, size, &config) == VP8_STATUS_OK;
+    WebPFreeDecBuffer(&config.output);
+
+    if (!ok)
+    {
+        return QImage();
+    }
+
+    if (scale < 1.0)
+    {
+        result.setText(DECODE_SCALE_KEY, QString::number(1.0 / scale));
+    }
+    return result;
+}
+
+#endif
+
+#ifdef IGAL_HAVE_LIBTIFF
+
+// Smaller TIFFs decode just as fast through QImage
+const uint64_t TIFF_PARALLEL_MIN_PIXELS = 16 * 1024 * 1024;
+
+// libtiff only decodes whole strips: files stored as a few huge strips are left to QImage
+const uint64_t TIFF_MAX_STRIP_BYTES = 64 * 1024 * 1024;
+
+// Source pixels averaged into one output pixel, bounded so that 32-bit channel sums can't overflow
+const uint64_t TIFF_MAX_BOX_PIXELS = 16 * 1024 * 1024;
+
+// Seekable read-only view over the mapped file, one per TIFF handle
+struct TiffMemoryStream
+{
+    const uint8_t* data = nullptr;
+    uint64_t size = 0;
+    uint64_t pos = 0;
+};
+
+tmsize_t tiffRead(thandle_t handle, void* buffer, tmsize_t size)
+{
+    auto* stream = static_cast<TiffMemoryStream*>(handle);
+    uint64_t count = std::min<uint64_t>(size, stream->size - std::min(stream->pos, stream->size));
+    std::copy(stream->data + stream->pos, stream->data + stream->pos + count, static_cast<uint8_t*>(buffer));
+    stream->pos += count;
+    return static_cast<tmsize_t>(count);
+}
+
+tmsize_t tiffWrite(thandle_t, void*, tmsize_t)
+{
+    return 0;
+}
+
+toff_t tiffSeek(thandle_t handle, toff_t offset, int whence)
+{
+    auto* stream = static_cast<TiffMemoryStream*>(handle);
+    switch (whence)
+    {
+    case SEEK_SET:
+        stream->pos = offset;
+        break;
+    case SEEK_CUR:
+        stream->pos += offset;
+        break;
+    case SEEK_END:
+        stream->pos = stream->size + offset;
+        break;
+    default:
+        break;
+    }
+    return stream->pos;
+}
+
+int tiffClose(thandle_t)
+{
+    return 0;
+}
+
+toff_t tiffSize(thandle_t handle)
+{
+    return static_cast<TiffMemoryStream*>(handle)->size;
+}
+
+// The data is already mapped, libtiff can read strips and tiles from it directly
+int tiffMap(thandle_t handle, void** base, toff_t* size)
+{
+    auto* stream = static_cast<TiffMemoryStream*>(handle);
+    *base = const_cast<uint8_t*>(stream->data);
+    *size = stream->size;
+    return 1;
+}
+
+void tiffUnmap(thandle_t, void*, toff_t)
+{ }
+
+// libtiff handles aren't thread safe: every decoding thread opens its own
+class TiffHandle
+{
+public:
+    TiffHandle(const uint8_t* data, size_t size)
+    {
+        static std::once_flag silenceFlag;
+        std::call_once(silenceFlag, []()
+        {
+            TIFFSetWarningHandler(nullptr);
+            TIFFSetErrorHandler(nullptr);
+        });
+
+        stream.data = data;
+        stream.size = size;
+        tif = TIFFClientOpen("igal", "r", &stream, tiffRead, tiffWrite, tiffSeek, tiffClose, tiffSize, tiffMap, tiffUnmap);
+    }
+
+    ~TiffHandle()
+    {
+        if (tif)
+        {
+            TIFFClose(tif);
+        }
+    }
+
+    TiffHandle(const TiffHandle&) = delete;
+    TiffHandle& operator=(const TiffHandle&) = delete;
+
+    TIFF* get() const { return tif; }
+
+private:
+    TiffMemoryStream stream;
+    TIFF* tif = nullptr;
+};
+
+struct TiffLayout
+{
+    uint32_t directory = 0;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    bool tiled = false;
+
+    // Tile size, or image width and rows per strip
+    uint32_t blockWidth = 0;
+    uint32_t blockHeight = 0;
+
+    bool alpha = false;
+};
+
+bool readTiffLayout(TIFF* tif, uint32_t directory, TiffLayout& layout)
+{
+    layout.directory = directory;
+    if (!TIFFGetField(tif, TIFFTAG_IMAGEWIDTH, &layout.width)
+        || !TIFFGetField(tif, TIFFTAG_IMAGELENGTH, &layout.height)
+        || layout.width == 0
+        || layout.height == 0)
+    {
+        return false;
+    }
+
+    layout.tiled = TIFFIsTiled(tif);
+    if (layout.tiled)
+    {
+        if (!TIFFGetField(tif, TIFFTAG_TILEWIDTH, &layout.blockWidth)
+            || !TIFFGetField(tif, TIFFTAG_TILELENGTH, &layout.blockHeight))
+        {
+            return false;
+        }
+    }
+    else
+    {
+        uint32_t rowsPerStrip = 0;
+        TIFFGetFieldDefaulted(tif, TIFFTAG_ROWSPERSTRIP, &rowsPerStrip);
+        layout.blockWidth = layout.width;
+        layout.blockHeight = std::clamp<uint32_t>(rowsPerStrip, 1, layout.height);
+    }
+
+    uint16_t extraCount = 0;
+    uint16_t* extraSamples = nullptr;
+    TIFFGetFieldDefaulted(tif, TIFFTAG_EXTRASAMPLES, &extraCount, &extraSamples);
+    layout.alpha = extraCount > 0
+        && (extraSamples[0] == EXTRASAMPLE_ASSOCALPHA || extraSamples[0] == EXTRASAMPLE_UNASSALPHA);
+
+    char message[1024];
+    return layout.blockWidth > 0 && layout.blockHeight > 0 && TIFFRGBAImageOK(tif, message);
+}
+
+// Picks the smallest reduced-resolution page (as stored in pyramidal TIFFs)
+// that still covers the fitted target size, or the full image
+bool chooseTiffLayout(TIFF* tif, const QSize& targetSize, TiffLayout& layout)
+{
+    if (!readTiffLayout(tif, 0, layout))
+    {
+        return false;
+    }
+
+    double scale = getFitScale(layout.width, layout.height, targetSize);
+    uint64_t minWidth = static_cast<uint64_t>(std::ceil(layout.width * scale));
+    uint64_t minHeight = static_cast<uint64_t>(std::ceil(layout.height * scale));
+
+    for (uint32_t directory = 1; scale < 1.0 && TIFFReadDirectory(tif); ++directory)
+    {
+        uint32_t subfileType = 0;
+        TiffLayout reduced;
+        if (TIFFGetField(tif, TIFFTAG_SUBFILETYPE, &subfileType)
+            && (subfileType & FILETYPE_REDUCEDIMAGE)
+            && readTiffLayout(tif, directory, reduced)
+            && reduced.width >= minWidth
+            && reduced.height >= minHeight
+            && uint64_t(reduced.width) * reduced.height < uint64_t(layout.width) * layout.height)
+        {
+            layout = reduced;
+        }
+    }
+    return true;
+}
+
+// Large TIFFs are decoded in bands of output rows, one band per thread at a
+// time. Every thread reads the tiles or strips its band covers and averages
+// them straight into the output, so the full resolution image never exists in
+// memory at once when scaling down.
+QImage decodeTiff(const uint8_t* data, size_t size, const QSize& targetSize)
+{
+    TiffLayout layout;
+    uint64_t fullPixels = 0;
+    {
+        TiffHandle handle(data, size);
+        if (!handle.get())
+        {
+            return QImage();
+        }
+
+        uint32_t fullWidth = 0;
+        uint32_t fullHeight = 0;
+        TIFFGetField(handle.get(), TIFFTAG_IMAGEWIDTH, &fullWidth);
+        TIFFGetField(handle.get(), TIFFTAG_IMAGELENGTH, &fullHeight);
+        fullPixels = uint64_t(fullWidth) * fullHeight;
+
+        if (fullPixels < TIFF_PARALLEL_MIN_PIXELS || !chooseTiffLayout(handle.get(), targetSize, layout))
+        {
+            return QImage();
+        }
+    }
+
+    uint64_t blockBytes = uint64_t(layout.blockWidth) * layout.blockHeight * sizeof(uint32_t);
+    if (!layout.tiled && blockBytes > TIFF_MAX_STRIP_BYTES)
+    {
+        return QImage();
+    }
+
+    double scale = getFitScale(layout.width, layout.height, targetSize);
+    uint32_t outWidth = std::max(1u, static_cast<uint32_t>(std::ceil(layout.width * scale)));
+    uint32_t outHeight = std::max(1u, static_cast<uint32_t>(std::ceil(layout.height * scale)));
+    bool direct = outWidth == layout.width && outHeight == layout.height;
+
+    uint64_t boxPixels = (uint64_t(layout.width) / outWidth + 1) * (uint64_t(layout.height) / outHeight + 1);
+    if (boxPixels > TIFF_MAX_BOX_PIXELS)
+    {
+        return QImage();
+    }
+
+    QImage result(outWidth, outHeight, layout.alpha ? QImage::Format_ARGB32_Premultiplied : QImage::Format_RGB32);
+    if (result.isNull())
+    {
+        return QImage();
+    }
+
+    // Source row/column y lands in output row/column y * out / in
+    auto firstSourceRow = [&](uint64_t outRow) { return static_cast<uint32_t>((outRow * layout.height + outHeight - 1) / outHeight); };
+
+    std::vector<uint32_t> outColumn(layout.width);
+    std::vector<uint32_t> columnCount(outWidth, 0);
+    for (uint32_t x = 0; x < layout.width; ++x)
+    {
+        outColumn[x] = static_cast<uint32_t>(uint64_t(x) * outWidth / layout.width);
+        ++columnCount[outColumn[x]];
+    }
+
+    // Bands span a few tile rows each, so the rows shared by two bands are only a small overhead
+    size_t threadCount = std::max(1u, std::thread::hardware_concurrency());
+    size_t bandCount = std::clamp<size_t>(layout.height / (uint64_t(layout.blockHeight) * 4), 1, threadCount * 2);
+    bandCount = std::min<size_t>(bandCount, outHeight);
+
+    std::atomic<size_t> nextBand = 0;
+    std::atomic<bool> failed = false;
+
+    auto decodeBands = [&]()
+    {
+        TiffHandle handle(data, size);
+        TIFF* tif = handle.get();
+        if (!tif || !TIFFSetDirectory(tif, layout.directory))
+        {
+            failed = true;
+            return;
+        }
+
+        std::vector<uint32_t> raster(uint64_t(layout.blockWidth) * layout.blockHeight);
+        std::vector<uint32_t> sums;
+
+        for (size_t band = nextBand++; band < bandCount && !failed; band = nextBand++)
+        {
+            uint32_t outRowBegin = static_cast<uint32_t>(uint64_t(outHeight) * band / bandCount);
+            uint32_t outRowEnd = static_cast<uint32_t>(uint64_t(outHeight) * (band + 1) / bandCount);
+            uint32_t rowBegin = firstSourceRow(outRowBegin);
+            uint32_t rowEnd = firstSourceRow(outRowEnd);
+
+            if (!direct)
+            {
+                sums.assign(uint64_t(outRowEnd - outRowBegin) * outWidth * 4, 0);
+            }
+
+            for (uint32_t blockY = rowBegin - rowBegin % layout.blockHeight; blockY < rowEnd; blockY += layout.blockHeight)
+            {
+                uint32_t blockRows = std::min(layout.blockHeight, layout.height - blockY);
+
+                for (uint32_t blockX = 0; blockX < layout.width; blockX += layout.blockWidth)
+                {
+                    bool ok = layout.tiled
+                        ? TIFFReadRGBATile(tif, blockX, blockY, raster.data())
+                        : TIFFReadRGBAStrip(tif, blockY, raster.data());
+                    if (!ok)
+                    {
+                        failed = true;
+                        return;
+                    }
+
+                    uint32_t blockColumns = std::min(layout.blockWidth, layout.width - blockX);
+                    uint32_t firstRow = std::max(rowBegin, blockY) - blockY;
+                    uint32_t lastRow = std::min(rowEnd, blockY + blockRows) - blockY;
+
+                    for (uint32_t row = firstRow; row < lastRow; ++row)
+                    {
+                        // The raster is bottom-up: tiles are padded to full height, strips aren't
+                        uint32_t rasterRow = (layout.tiled ? layout.blockHeight : blockRows) - 1 - row;
+                        const uint32_t* src = raster.data() + uint64_t(rasterRow) * layout.blockWidth;
+                        uint32_t y = blockY + row;
+
+                        if (direct)
+                        {
+                            auto* dst = reinterpret_cast<QRgb*>(result.scanLine(y)) + blockX;
+                            for (uint32_t col = 0; col < blockColumns; ++col)
+                            {
+                                uint32_t px = src[col];
+                                dst[col] = qRgba(TIFFGetR(px), TIFFGetG(px), TIFFGetB(px), layout.alpha ? TIFFGetA(px) : 255);
+                            }
+                            continue;
+                        }
+
+                        uint32_t outRow = static_cast<uint32_t>(uint64_t(y) * outHeight / layout.height);
+                        uint32_t* dst = sums.data() + uint64_t(outRow - outRowBegin) * outWidth * 4;
+                        for (uint32_t col = 0; col < blockColumns; ++col)
+                        {
+                            uint32_t px = src[col];
+                            uint32_t* sum = dst + uint64_t(outColumn[blockX + col]) * 4;
+                            sum[0] += TIFFGetR(px);
+                            sum[1] += TIFFGetG(px);
+                            sum[2] += TIFFGetB(px);
+                            sum[3] += TIFFGetA(px);
+                        }
+                    }
+                }
+            }
+
+            if (direct)
+            {
+                continue;
+            }
+
+            for (uint32_t outRow = outRowBegin; outRow < outRowEnd; ++outRow)
+            {
+                uint32_t rowCount = firstSourceRow(outRow + 1) - firstSourceRow(outRow);
+                const uint32_t* sum = sums.data() + uint64_t(outRow - outRowBegin) * outWidth * 4;
+                auto* dst = reinterpret_cast<QRgb*>(result.scanLine(outRow));
+
+                for (uint32_t x = 0; x < outWidth; ++x, sum += 4)
+                {
+                    uint32_t count = std::max(1u, rowCount * columnCount[x]);
+                    auto average = [&](int channel) { return static_cast<int>((sum[channel] + count / 2) / count); };
+                    dst[x] = qRgba(average(0), average(1), average(2), layout.alpha ? average(3) : 255);
+                }
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < std::min(threadCount, bandCount); ++i)
+    {
+        threads.emplace_back(decodeBands);
+    }
+    decodeBands();
+
+    for (auto& t : threads)
+    {
+        t.join();
+    }
+
+    if (failed)
+    {
+        return QImage();
+    }
+
+    double decodeScale = std::sqrt(double(fullPixels) / (uint64_t(outWidth) * outHeight));
+    if (decodeScale > 1.0)
+    {
+        result.setText(DECODE_SCALE_KEY, QString::number(decodeScale));
+    }
+    return result;
+}
+
+#endif
+
+// Smallest embedded JPEG covering the fitted target size (at most 'maxBytes'
+// long), else the largest one there is. Null if there is none.
+const EmbeddedJpeg* chooseEmbeddedJpeg(const std::vector<EmbeddedJpeg>& jpegs, const QSize& targetSize, size_t maxBytes)
+{
+    const EmbeddedJpeg* result = nullptr;
+    for (const auto& jpeg : jpegs)
+    {
+        if (jpeg.length > maxBytes)
+        {
+            continue;
+        }
+
+        result = &jpeg;
+        if (getFitScale(jpeg.width, jpeg.height, targetSize) >= 1.0 && !targetSize.isEmpty())
+        {
+            break;
+        }
+    }
+    return result;
+}
+
+// Decodes one encoded image as is, without looking at its metadata
+QImage decodeEncodedImage(const uint8_t* data, size_t size, const fs_str_t& ext, const QSize& targetSize)
+{
+    QImage result;
+
+#ifdef IGAL_HAVE_LIBJPEG
+    if (isJpegData(data, size))
+    {
+        result = decodeJpeg(data, size, targetSize);
+    }
+#endif
+
+#ifdef IGAL_HAVE_LIBWEBP
+    if (isWebpData(data, size))
+    {
+        result = decodeWebp(data, size, targetSize);
+    }
+#endif
+
+#ifdef IGAL_HAVE_LIBTIFF
+    if (isTiffData(data, size))
+    {
+        result = decodeTiff(data, size, targetSize);
+    }
+#endif
+
+    if (result.isNull())
+    {
+        // Pass the extension as format hint: not every format (e.g. TGA) can be sniffed from its contents
+        QByteArray format = fsstrToQstring(ext).mid(1).toLatin1();
+        result = QImage::fromData(data, static_cast<int>(size), format.isEmpty() ? nullptr : format.constData());
+    }
+    return result;
+}
+
+// Picks and decodes an embedded preview, turned like the file holding it.
+// RAF headers carry no orientation: there it comes from the preview's own EXIF.
+QImage decodeEmbeddedJpeg(const uint8_t* data, size_t size, QSize targetSize, size_t maxBytes)
+{
+    int orientation = readExifOrientation(data, size);
+    if (fromExifOrientation(orientation).isTransposed())
+    {
+        targetSize.transpose();
+    }
+
+    auto jpegs = findEmbeddedJpegs(data, size);
+    const EmbeddedJpeg* jpeg = chooseEmbeddedJpeg(jpegs, targetSize, maxBytes);
+    if (!jpeg)
+    {
+        return QImage();
+    }
+
+    const uint8_t* jpegData = data + jpeg->offset;
+    if (orientation == 1)
+    {
+        orientation = readExifOrientation(jpegData, jpeg->length);
+        if (fromExifOrientation(orientation).isTransposed())
+        {
+            targetSize.transpose();
+        }
+    }
+
+    QImage result = decodeEncodedImage(jpegData, jpeg->length, FSSTR(".jpg"), targetSize);
+    if (!result.isNull() && orientation != 1)
+    {
+        result.setText(DECODE_ORIENTATION_KEY, QString::number(orientation));
+    }
+    return result;
+}
+
+QImage decodeImageData(const uint8_t* data, size_t size, const fs_str_t& ext, QSize targetSize)
+{
+    // Camera RAW files are shown through the best JPEG preview the camera embedded
+    if (rawImageExtensions.count(ext) != 0)
+    {
+        return decodeEmbeddedJpeg(data, size, targetSize, size);
+    }
+
+    // Sideways photos are turned on screen: fit them to the turned target
+    int orientation = isJpegData(data, size) ? readExifOrientation(data, size) : 1;
+    if (fromExifOrientation(orientation).isTransposed())
+    {
+        targetSize.transpose();
+    }
+
+    QImage result = decodeEncodedImage(data, size, ext, targetSize);
+    if (!result.isNull() && orientation != 1)
+    {
+        result.setText(DECODE_ORIENTATION_KEY, QString::number(orientation));
+    }
+    return result;
+}
+
+QImage decodeImage(const fs_str_t& path, const QSize& targetSize)
+{
+    ArchiveMemberData member;
+    if (readArchiveMember(path, member))
+    {
+        return decodeImageData(member.data, member.size, getTargetExtension(path), targetSize);
+    }
+
+    MappedFile file(path);
+    if (!file.isValid())
+    {
+        return QImage();
+    }
+    file.adviseWillNeed(0, file.size());
+
+    return decodeImageData(file.data(), file.size(), getTargetExtension(path), targetSize);
+}
+
+QImage decodeEmbeddedPreview(const fs_str_t& path, const QSize& targetSize, size_t maxBytes)
+{
+    MappedFile file(path);
+    if (!file.isValid())
+    {
+        return QImage();
+    }
+
+    QImage result = decodeEmbeddedJpeg(file.data(), file.size(), targetSize, maxBytes);
+
+    // Always a stand-in for the full image, whatever its size
+    if (!result.isNull() && !isReducedDecode(result))
+    {
+        result.setText(DECODE_SCALE_KEY, QString::number(1));
+    }
+    return result;
+}
+
+bool isReducedDecode(const QImage& image)
+{
+    return !image.text(DECODE_SCALE_KEY).isEmpty();
+}
+
+Orientation getDecodedOrientation(const QImage& image)
+{
+    return fromExifOrientation(image.text(DECODE_ORIENTATION_KEY).toInt());
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <QtCore/qsize.h>
+
+#include <QtGui/qimage.h>
+
+#include "defs.h"
+#include "orientation.h"
+
+// Decodes an image file. JPEG and WebP go through libjpeg-turbo/libwebp when
+// available, scaled down in the decoder to the smallest size still covering
+// 'targetSize'. An empty 'targetSize' always decodes at full resolution.
+// Large TIFFs go through libtiff when available: tiles or strips are decoded
+// on every core and averaged straight down to 'targetSize', using a reduced
+// resolution page of pyramidal files when one covers it.
+// Any other format (or a failing fast path) falls back to QImage.
+// Members of ZIP/CBZ archives are decoded from memory (see archive.h).
+// Pixels are never rotated: the EXIF orientation of JPEGs is only recorded
+// (see getDecodedOrientation) and 'targetSize' is matched after turning.
+QImage decodeImage(const fs_str_t& path, const QSize& targetSize = QSize());
+
+// Decodes the JPEG preview embedded in a JPEG (EXIF thumbnail) or camera RAW
+// file: the smallest one covering 'targetSize' that is at most 'maxBytes'
+// long, else the largest. Only touches the metadata and that preview, for a
+// picture long before the full decode is done. Null if there is none.
+QImage decodeEmbeddedPreview(const fs_str_t& path, const QSize& targetSize, size_t maxBytes);
+
+// True if the image was decoded below its full resolution
+bool isReducedDecode(const QImage& image);
+
+// How the decoded pixels have to be turned for display
+Orientation getDecodedOrientation(const QImage& image);
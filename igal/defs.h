@@ -1,9 +1,12 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 
 #if defined(WIN32) || defined(_WIN32)
 	typedef std::wstring fs_str_t;
+	typedef std::wstring_view fs_strview_t;
 #else
 	typedef std::string fs_str_t;
+	typedef std::string_view fs_strview_t;
 #endif
\ No newline at end of file
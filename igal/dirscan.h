@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "defs.h"
+
+struct ScanEntry
+{
+    fs_str_t name;
+    long long mtime = 0;
+    uint64_t size = 0;
+};
+
+// Lists (by filename) the regular files in 'dir' whose name passes 'filter', with their size and
+// modification time. Metadata is fetched in batches (io_uring on Linux when
+// available, a pool of stat threads otherwise) instead of one blocking call per entry.
+std::vector<ScanEntry> scanDirectory(const fs_str_t& dir, const std::function<bool(const fs_str_t&)>& filter);
@@ -0,0 +1,606 @@
+#include "exif.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "fsutils.h"
+
+const size_t EXIF_HEADER_READ_SIZE = 64 * 1024;
+
+const uint16_t EXIF_TAG_COMPRESSION = 0x0103;
+const uint16_t EXIF_TAG_STRIP_OFFSETS = 0x0111;
+const uint16_t EXIF_TAG_ORIENTATION = 0x0112;
+const uint16_t EXIF_TAG_STRIP_BYTE_COUNTS = 0x0117;
+const uint16_t EXIF_TAG_SUB_IFDS = 0x014A;
+const uint16_t EXIF_TAG_JPEG_OFFSET = 0x0201;
+const uint16_t EXIF_TAG_JPEG_LENGTH = 0x0202;
+const uint16_t EXIF_TAG_DATETIME = 0x0132;
+const uint16_t EXIF_TAG_EXIF_IFD = 0x8769;
+const uint16_t EXIF_TAG_DATETIME_ORIGINAL = 0x9003;
+
+const uint16_t EXIF_TYPE_ASCII = 2;
+const uint16_t EXIF_TYPE_SHORT = 3;
+const uint16_t EXIF_TYPE_LONG = 4;
+const uint16_t EXIF_TYPE_IFD = 13;
+
+// Old-style and new-style JPEG compression in TIFF directories
+const uint32_t TIFF_COMPRESSION_OJPEG = 6;
+const uint32_t TIFF_COMPRESSION_JPEG = 7;
+
+// Guards against directory loops in broken files
+const size_t EXIF_MAX_DIRECTORIES = 32;
+
+const char RAF_MAGIC[] = "FUJIFILMCCD-RAW";
+const size_t RAF_JPEG_OFFSET_POS = 84;
+
+// Read-only view over a TIFF structure (either a .tiff file or a JPEG APP1 payload)
+class TiffView
+{
+public:
+    TiffView(const uint8_t* data, size_t size)
+        : data(data)
+        , size(size)
+    {
+        if (size < 8)
+        {
+            return;
+        }
+
+        if (data[0] == 'I' && data[1] == 'I')
+        {
+            littleEndian = true;
+        }
+        else if (data[0] != 'M' || data[1] != 'M')
+        {
+            return;
+        }
+        valid = u16(2) == 42;
+    }
+
+    bool isValid() const { return valid; }
+    bool isLittleEndian() const { return littleEndian; }
+
+    uint16_t u16(size_t offset) const
+    {
+        if (offset + 2 > size)
+        {
+            return 0;
+        }
+        return littleEndian
+            ? uint16_t(data[offset] | (data[offset + 1] << 8))
+            : uint16_t((data[offset] << 8) | data[offset + 1]);
+    }
+
+    uint32_t u32(size_t offset) const
+    {
+        if (offset + 4 > size)
+        {
+            return 0;
+        }
+        return littleEndian
+            ? (uint32_t(u16(offset + 2)) << 16) | u16(offset)
+            : (uint32_t(u16(offset)) << 16) | u16(offset + 2);
+    }
+
+    uint32_t firstIfd() const { return u32(4); }
+
+    // Offset of the 12-byte directory entry for 'tag', or 0 if absent
+    size_t findEntry(uint32_t ifd, uint16_t tag) const
+    {
+        if (ifd == 0 || ifd + 2 > size)
+        {
+            return 0;
+        }
+
+        uint16_t count = u16(ifd);
+        for (uint16_t i = 0; i < count; ++i)
+        {
+            size_t entry = ifd + 2 + size_t(i) * 12;
+            if (entry + 12 > size)
+            {
+                return 0;
+            }
+            if (u16(entry) == tag)
+            {
+                return entry;
+            }
+        }
+        return 0;
+    }
+
+    uint32_t entryUint(size_t entry) const
+    {
+        switch (u16(entry + 2))
+        {
+        case EXIF_TYPE_SHORT:
+            return u16(entry + 8);
+        case EXIF_TYPE_LONG:
+        case EXIF_TYPE_IFD:
+            return u32(entry + 8);
+        default:
+            return 0;
+        }
+    }
+
+    // Values of a LONG/IFD array entry
+    std::vector<uint32_t> entryUints(size_t entry) const
+    {
+        std::vector<uint32_t> result;
+        uint16_t type = u16(entry + 2);
+        uint32_t count = u32(entry + 4);
+        if ((type != EXIF_TYPE_LONG && type != EXIF_TYPE_IFD) || count == 0 || count > EXIF_MAX_DIRECTORIES)
+        {
+            return result;
+        }
+
+        size_t offset = count == 1 ? entry + 8 : u32(entry + 8);
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            result.push_back(u32(offset + size_t(i) * 4));
+        }
+        return result;
+    }
+
+    uint32_t nextIfd(uint32_t ifd) const
+    {
+        return u32(ifd + 2 + size_t(u16(ifd)) * 12);
+    }
+
+    std::string entryString(size_t entry) const
+    {
+        if (u16(entry + 2) != EXIF_TYPE_ASCII)
+        {
+            return std::string();
+        }
+
+        uint32_t count = u32(entry + 4);
+        size_t offset = count <= 4 ? entry + 8 : u32(entry + 8);
+        if (offset + count > size)
+        {
+            return std::string();
+        }
+
+        std::string result(reinterpret_cast<const char*>(data + offset), count);
+        auto end = result.find('\0');
+        if (end != std::string::npos)
+        {
+            result.resize(end);
+        }
+        return result;
+    }
+
+private:
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+    bool littleEndian = false;
+    bool valid = false;
+};
+
+std::vector<uint8_t> readFileHeader(const fs_str_t& path, size_t maxBytes)
+{
+    std::vector<uint8_t> result(maxBytes);
+
+    std::ifstream ifs(path, std::ios::binary);
+    ifs.read(reinterpret_cast<char*>(result.data()), result.size());
+    result.resize(ifs.gcount());
+
+    return result;
+}
+
+bool isJpeg(const uint8_t* data, size_t size)
+{
+    return size >= 4 && data[0] == 0xFF && data[1] == 0xD8;
+}
+
+size_t getSegmentLength(const uint8_t* data, size_t pos)
+{
+    return (data[pos + 2] << 8) | data[pos + 3];
+}
+
+// Offset of the APP1 marker of the EXIF segment in JPEG data, 0 if there is none
+size_t findExifSegment(const uint8_t* data, size_t size)
+{
+    size_t pos = 2;
+    while (pos + 4 <= size && data[pos] == 0xFF)
+    {
+        uint8_t marker = data[pos + 1];
+        size_t segmentLength = getSegmentLength(data, pos);
+
+        // Start of scan: no metadata segments past this point
+        if (marker == 0xDA)
+        {
+            break;
+        }
+
+        const uint8_t* payload = data + pos + 4;
+        if (marker == 0xE1
+            && segmentLength >= 8
+            && pos + 2 + segmentLength <= size
+            && std::equal(payload, payload + 6, "Exif\0\0"))
+        {
+            return pos;
+        }
+        pos += 2 + segmentLength;
+    }
+    return 0;
+}
+
+// Locates the TIFF structure holding the EXIF data inside a file header
+TiffView findTiffView(const uint8_t* data, size_t size)
+{
+    if (isJpeg(data, size))
+    {
+        size_t segment = findExifSegment(data, size);
+        if (segment == 0)
+        {
+            return TiffView(nullptr, 0);
+        }
+        return TiffView(data + segment + 10, getSegmentLength(data, segment) - 8);
+    }
+
+    return TiffView(data, size);
+}
+
+long long parseExifDateTime(const std::string& str)
+{
+    // "YYYY:MM:DD hh:mm:ss"
+    if (str.size() < 19)
+    {
+        return -1;
+    }
+
+    long long result = 0;
+    for (size_t i = 0; i < 19; ++i)
+    {
+        if (i == 4 || i == 7 || i == 10 || i == 13 || i == 16)
+        {
+            continue;
+        }
+        if (str[i] < '0' || str[i] > '9')
+        {
+            return -1;
+        }
+        result = result * 10 + (str[i] - '0');
+    }
+    return result > 0 ? result : -1;
+}
+
+long long readExifCaptureTime(const fs_str_t& path)
+{
+    auto header = readFileHeader(path, EXIF_HEADER_READ_SIZE);
+    TiffView tiff = findTiffView(header.data(), header.size());
+    if (!tiff.isValid())
+    {
+        return -1;
+    }
+
+    uint32_t ifd0 = tiff.firstIfd();
+    if (size_t exifEntry = tiff.findEntry(ifd0, EXIF_TAG_EXIF_IFD))
+    {
+        if (size_t entry = tiff.findEntry(tiff.entryUint(exifEntry), EXIF_TAG_DATETIME_ORIGINAL))
+        {
+            long long result = parseExifDateTime(tiff.entryString(entry));
+            if (result != -1)
+            {
+                return result;
+            }
+        }
+    }
+
+    if (size_t entry = tiff.findEntry(ifd0, EXIF_TAG_DATETIME))
+    {
+        return parseExifDateTime(tiff.entryString(entry));
+    }
+    return -1;
+}
+
+int readExifOrientation(const uint8_t* data, size_t size)
+{
+    TiffView tiff = findTiffView(data, std::min(size, EXIF_HEADER_READ_SIZE));
+    size_t entry = tiff.isValid() ? tiff.findEntry(tiff.firstIfd(), EXIF_TAG_ORIENTATION) : 0;
+    uint32_t value = entry ? tiff.entryUint(entry) : 1;
+    return (value >= 1 && value <= 8) ? static_cast<int>(value) : 1;
+}
+
+// Dimensions from the frame header of a baseline, extended or progressive JPEG
+bool readJpegFrameSize(const uint8_t* data, size_t size, int& width, int& height)
+{
+    if (!isJpeg(data, size))
+    {
+        return false;
+    }
+
+    size_t pos = 2;
+    while (pos + 9 <= size && data[pos] == 0xFF)
+    {
+        uint8_t marker = data[pos + 1];
+        if (marker == 0xC0 || marker == 0xC1 || marker == 0xC2)
+        {
+            height = (data[pos + 5] << 8) | data[pos + 6];
+            width = (data[pos + 7] << 8) | data[pos + 8];
+            return width > 0 && height > 0;
+        }
+
+        // Any other frame type (lossless, arithmetic coding...) or the scan itself
+        if ((marker >= 0xC3 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC) || marker == 0xDA)
+        {
+            return false;
+        }
+        pos += 2 + getSegmentLength(data, pos);
+    }
+    return false;
+}
+
+void addEmbeddedJpeg(const uint8_t* data, size_t size, uint64_t offset, uint64_t length, std::vector<EmbeddedJpeg>& result)
+{
+    if (offset == 0 || length == 0 || offset >= size || length > size - offset)
+    {
+        return;
+    }
+
+    EmbeddedJpeg jpeg;
+    jpeg.offset = static_cast<size_t>(offset);
+    jpeg.length = static_cast<size_t>(length);
+    if (readJpegFrameSize(data + jpeg.offset, jpeg.length, jpeg.width, jpeg.height))
+    {
+        result.push_back(jpeg);
+    }
+}
+
+std::vector<EmbeddedJpeg> findEmbeddedJpegs(const uint8_t* data, size_t size)
+{
+    std::vector<EmbeddedJpeg> result;
+
+    if (size >= RAF_JPEG_OFFSET_POS + 8 && std::equal(RAF_MAGIC, RAF_MAGIC + sizeof(RAF_MAGIC) - 1, data))
+    {
+        auto readBigU32 = [&](size_t pos) { return (uint32_t(data[pos]) << 24) | (data[pos + 1] << 16) | (data[pos + 2] << 8) | data[pos + 3]; };
+        addEmbeddedJpeg(data, size, readBigU32(RAF_JPEG_OFFSET_POS), readBigU32(RAF_JPEG_OFFSET_POS + 4), result);
+        return result;
+    }
+
+    // Offsets inside the EXIF block of a JPEG are relative to its TIFF header
+    size_t base = 0;
+    size_t tiffSize = size;
+    if (isJpeg(data, size))
+    {
+        size_t segment = findExifSegment(data, std::min(size, EXIF_HEADER_READ_SIZE));
+        if (segment == 0)
+        {
+            return result;
+        }
+        base = segment + 10;
+        tiffSize = getSegmentLength(data, segment) - 8;
+    }
+
+    TiffView tiff(data + base, tiffSize);
+    if (!tiff.isValid())
+    {
+        return result;
+    }
+
+    // IFD0, the IFDs chained after it and their sub-IFDs
+    std::vector<uint32_t> pending = { tiff.firstIfd() };
+    std::vector<uint32_t> visited;
+    while (!pending.empty() && visited.size() < EXIF_MAX_DIRECTORIES)
+    {
+        uint32_t ifd = pending.back();
+        pending.pop_back();
+        if (ifd == 0 || std::find(visited.begin(), visited.end(), ifd) != visited.end())
+        {
+            continue;
+        }
+        visited.push_back(ifd);
+
+        size_t offsetEntry = tiff.findEntry(ifd, EXIF_TAG_JPEG_OFFSET);
+        size_t lengthEntry = tiff.findEntry(ifd, EXIF_TAG_JPEG_LENGTH);
+        if (offsetEntry && lengthEntry)
+        {
+            addEmbeddedJpeg(data, size, base + uint64_t(tiff.entryUint(offsetEntry)), tiff.entryUint(lengthEntry), result);
+        }
+
+        // A JPEG stored as the single strip of a directory
+        size_t compressionEntry = tiff.findEntry(ifd, EXIF_TAG_COMPRESSION);
+        uint32_t compression = compressionEntry ? tiff.entryUint(compressionEntry) : 0;
+        size_t stripEntry = tiff.findEntry(ifd, EXIF_TAG_STRIP_OFFSETS);
+        size_t stripLengthEntry = tiff.findEntry(ifd, EXIF_TAG_STRIP_BYTE_COUNTS);
+        if ((compression == TIFF_COMPRESSION_OJPEG || compression == TIFF_COMPRESSION_JPEG)
+            && stripEntry
+            && stripLengthEntry
+            && tiff.u32(stripEntry + 4) == 1)
+        {
+            addEmbeddedJpeg(data, size, base + uint64_t(tiff.entryUint(stripEntry)), tiff.entryUint(stripLengthEntry), result);
+        }
+
+        if (size_t subEntry = tiff.findEntry(ifd, EXIF_TAG_SUB_IFDS))
+        {
+            for (uint32_t sub : tiff.entryUints(subEntry))
+            {
+                pending.push_back(sub);
+            }
+        }
+        pending.push_back(tiff.nextIfd(ifd));
+    }
+
+    // The same stream can be referenced twice (e.g. by offset/length tags and as a strip)
+    std::sort(result.begin(), result.end(), [](const EmbeddedJpeg& a, const EmbeddedJpeg& b)
+    {
+        return uint64_t(a.width) * a.height != uint64_t(b.width) * b.height
+            ? uint64_t(a.width) * a.height < uint64_t(b.width) * b.height
+            : a.offset < b.offset;
+    });
+    result.erase(std::unique(result.begin(), result.end(), [](const EmbeddedJpeg& a, const EmbeddedJpeg& b) { return a.offset == b.offset; }), result.end());
+    return result;
+}
+
+void putU16(std::vector<uint8_t>& data, size_t offset, uint16_t value, bool littleEndian)
+{
+    data[offset] = littleEndian ? uint8_t(value) : uint8_t(value >> 8);
+    data[offset + 1] = littleEndian ? uint8_t(value >> 8) : uint8_t(value);
+}
+
+void putU32(std::vector<uint8_t>& data, size_t offset, uint32_t value, bool littleEndian)
+{
+    putU16(data, offset + (littleEndian ? 0 : 2), uint16_t(value), littleEndian);
+    putU16(data, offset + (littleEndian ? 2 : 0), uint16_t(value >> 16), littleEndian);
+}
+
+// Orientation entry: SHORT, count 1, value inline
+void putOrientationEntry(std::vector<uint8_t>& data, size_t offset, int orientation, bool littleEndian)
+{
+    putU16(data, offset, EXIF_TAG_ORIENTATION, littleEndian);
+    putU16(data, offset + 2, EXIF_TYPE_SHORT, littleEndian);
+    putU32(data, offset + 4, 1, littleEndian);
+    putU32(data, offset + 8, 0, littleEndian);
+    putU16(data, offset + 8, static_cast<uint16_t>(orientation), littleEndian);
+}
+
+bool setJpegOrientation(std::vector<uint8_t>& file, int orientation)
+{
+    size_t segment = findExifSegment(file.data(), file.size());
+    if (segment == 0)
+    {
+        // Minimal big-endian EXIF block: TIFF header and an IFD0 holding only the orientation
+        std::vector<uint8_t> app1 = { 0xFF, 0xE1, 0, 0, 'E', 'x', 'i', 'f', 0, 0, 'M', 'M', 0, 42, 0, 0, 0, 8, 0, 1 };
+        app1.resize(app1.size() + 12 + 4, 0);
+        putOrientationEntry(app1, 20, orientation, false);
+        putU16(app1, 2, static_cast<uint16_t>(app1.size() - 2), false);
+
+        // JFIF requires its APP0 segment to come first
+        size_t insertPos = 2;
+        if (file.size() >= 6 && file[2] == 0xFF && file[3] == 0xE0)
+        {
+            insertPos += 2 + getSegmentLength(file.data(), 2);
+        }
+        file.insert(file.begin() + insertPos, app1.begin(), app1.end());
+        return true;
+    }
+
+    size_t segmentLength = getSegmentLength(file.data(), segment);
+    size_t tiffStart = segment + 10;
+    size_t tiffSize = segmentLength - 8;
+
+    TiffView tiff(file.data() + tiffStart, tiffSize);
+    if (!tiff.isValid())
+    {
+        return false;
+    }
+    bool littleEndian = tiff.isLittleEndian();
+    uint32_t ifd0 = tiff.firstIfd();
+
+    if (size_t entry = tiff.findEntry(ifd0, EXIF_TAG_ORIENTATION))
+    {
+        putOrientationEntry(file, tiffStart + entry, orientation, littleEndian);
+        return true;
+    }
+
+    // No tag yet: IFD0 is rewritten with the extra entry at the end of the TIFF
+    // data, so every other offset in the block stays valid
+    uint16_t count = tiff.u16(ifd0);
+    size_t ifdSize = 2 + size_t(count) * 12 + 4;
+    if (ifd0 == 0 || ifd0 + ifdSize > tiffSize)
+    {
+        return false;
+    }
+
+    size_t newIfd = tiffSize + tiffSize % 2;
+    size_t newTiffSize = newIfd + ifdSize + 12;
+    if (newTiffSize + 8 > 0xFFFF)
+    {
+        return false;
+    }
+
+    std::vector<uint8_t> ifd(ifdSize + 12);
+    putU16(ifd, 0, count + 1, littleEndian);
+
+    size_t out = 2;
+    bool inserted = false;
+    for (uint16_t i = 0; i < count; ++i)
+    {
+        size_t entry = ifd0 + 2 + size_t(i) * 12;
+        if (!inserted && tiff.u16(entry) > EXIF_TAG_ORIENTATION)
+        {
+            putOrientationEntry(ifd, out, orientation, littleEndian);
+            out += 12;
+            inserted = true;
+        }
+        std::copy_n(file.begin() + tiffStart + entry, 12, ifd.begin() + out);
+        out += 12;
+    }
+    if (!inserted)
+    {
+        putOrientationEntry(ifd, out, orientation, littleEndian);
+        out += 12;
+    }
+    putU32(ifd, out, tiff.u32(ifd0 + 2 + size_t(count) * 12), littleEndian);
+
+    std::vector<uint8_t> tail(newTiffSize - tiffSize, 0);
+    std::copy(ifd.begin(), ifd.end(), tail.begin() + (newIfd - tiffSize));
+    file.insert(file.begin() + tiffStart + tiffSize, tail.begin(), tail.end());
+
+    putU32(file, tiffStart + 4, static_cast<uint32_t>(newIfd), littleEndian);
+    putU16(file, segment + 2, static_cast<uint16_t>(newTiffSize + 8), false);
+    return true;
+}
+
+// Writes the bytes where 'updated' differs from 'original' (same size) over the file, leaving the rest alone
+bool writeChangedBytes(const fs_str_t& path, const std::vector<uint8_t>& original, const std::vector<uint8_t>& updated)
+{
+    auto first = std::mismatch(original.begin(), original.end(), updated.begin()).first - original.begin();
+    if (first == static_cast<ptrdiff_t>(original.size()))
+    {
+        return true;
+    }
+    auto last = original.size() - (std::mismatch(original.rbegin(), original.rend(), updated.rbegin()).first - original.rbegin());
+
+    std::fstream fs(path, std::ios::binary | std::ios::in | std::ios::out);
+    fs.seekp(first);
+    fs.write(reinterpret_cast<const char*>(updated.data() + first), last - first);
+    fs.flush();
+    return static_cast<bool>(fs);
+}
+
+bool writeJpegOrientation(const fs_str_t& requestedPath, int orientation)
+{
+    // A symlink stays one: the file it points to is rewritten
+    std::error_code ec;
+    fs_str_t path = std::filesystem::canonical(requestedPath, ec).native();
+    if (ec)
+    {
+        return false;
+    }
+
+    std::vector<uint8_t> original;
+    {
+        std::ifstream ifs(path, std::ios::binary);
+        if (!ifs)
+        {
+            return false;
+        }
+        original.assign(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+    }
+
+    std::vector<uint8_t> file = original;
+    if (!isJpeg(file.data(), file.size()) || !setJpegOrientation(file, orientation))
+    {
+        return false;
+    }
+
+    auto mtime = std::filesystem::last_write_time(path, ec);
+
+    // Only the tag value changed: the file itself is kept, with its permissions,
+    // owner and hard links. Otherwise the whole file is replaced.
+    bool written = file.size() == original.size()
+        ? writeChangedBytes(path, original, file)
+        : replaceFileContents(path, file.data(), file.size());
+
+    if (written && !ec)
+    {
+        std::filesystem::last_write_time(path, mtime, ec);
+    }
+    return written;
+}
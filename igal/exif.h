@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "defs.h"
+
+// Capture date from the EXIF DateTimeOriginal tag as a sortable YYYYMMDDhhmmss
+// integer, or -1 when the file carries none. Only the file header is read.
+long long readExifCaptureTime(const fs_str_t& path);
+
+// EXIF orientation tag (1-8) of JPEG or TIFF-based data, 1 when absent
+int readExifOrientation(const uint8_t* data, size_t size);
+
+// A JPEG stream stored inside another file, located by offset
+struct EmbeddedJpeg
+{
+    size_t offset = 0;
+    size_t length = 0;
+    int width = 0;
+    int height = 0;
+};
+
+// JPEG previews embedded in JPEG (the EXIF thumbnail), TIFF-based camera RAW
+// (CR2, NEF, ARW, DNG...) or Fujifilm RAF data, smallest first. Only the
+// metadata and the preview headers are touched, so on mapped files this reads
+// just a few pages. Lossless JPEG (RAW sensor data) is skipped.
+std::vector<EmbeddedJpeg> findEmbeddedJpegs(const uint8_t* data, size_t size);
+
+// Sets the orientation tag of a JPEG file in place, without touching the
+// compressed image data: the tag is updated, added to IFD0 or, for files
+// without EXIF data, a minimal APP1 segment is inserted. An updated tag is
+// written in place; a file that grows is replaced (see replaceFileContents),
+// which fails for hard-linked files.
+// Symlinks are followed, and the file keeps its modification time.
+bool writeJpegOrientation(const fs_str_t& path, int orientation);
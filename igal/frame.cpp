@@ -0,0 +1,86 @@
+#include "frame.h"
+
+#include <chrono>
+
+#include "decoder.h"
+#include "pixelcache.h"
+#include "sharedframes.h"
+
+FramePtr makeFrame(QImage image)
+{
+    if (image.isNull())
+    {
+        return nullptr;
+    }
+
+    auto frame = std::make_shared<Frame>();
+    frame->reduced = isReducedDecode(image);
+    frame->orientation = getDecodedOrientation(image);
+
+    QImage::Format format = image.hasAlphaChannel() ? QImage::Format_ARGB32_Premultiplied : QImage::Format_RGB32;
+    frame->image = image.format() == format ? std::move(image) : image.convertToFormat(format);
+    return frame;
+}
+
+QImage scaleFrameForDisplay(const Frame& frame, const QSize& viewport, const Orientation& viewOrientation)
+{
+    // Scale in the frame's own orientation, then turn the (display-sized) result
+    Orientation orientation = combineOrientations(frame.orientation, viewOrientation);
+    QSize fitSize = viewport;
+    if (orientation.isTransposed())
+    {
+        fitSize.transpose();
+    }
+
+    QImage result = frame.image.scaled(fitSize, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+    return orientation.isIdentity() ? result : applyOrientation(result, orientation);
+}
+
+FramePtr prepareDisplayFrame(const FramePtr& frame, const QSize& viewport)
+{
+    if (!frame)
+    {
+        return nullptr;
+    }
+
+    auto result = std::make_shared<Frame>(*frame);
+    result->display = scaleFrameForDisplay(*frame, viewport);
+    result->displayViewport = viewport;
+    return result;
+}
+
+FramePtr decodeFrame(const fs_str_t& path, const QSize& targetSize)
+{
+    // Another igal process may have decoded it already
+    if (FramePtr shared = loadSharedFrame(path, targetSize))
+    {
+        return shared;
+    }
+
+    // Pixel cache entries are mapped files, shared through the page cache anyway
+    if (FramePtr cached = loadCachedFrame(path, targetSize))
+    {
+        return cached;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    FramePtr frame = makeFrame(decodeImage(path, targetSize));
+    double decodeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    reportDecodedFrame(path, targetSize, frame, decodeMs);
+    publishSharedFrame(path, targetSize, frame);
+    return frame;
+}
+
+FramePtr decodePreviewFrame(const fs_str_t& path, const QSize& targetSize, size_t maxBytes)
+{
+    FramePtr frame = makeFrame(decodeEmbeddedPreview(path, targetSize, maxBytes));
+    if (!frame)
+    {
+        return nullptr;
+    }
+
+    auto result = std::make_shared<Frame>(*frame);
+    result->preview = true;
+    return result;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <memory>
+
+#include <QtCore/qsize.h>
+
+#include <QtGui/qimage.h>
+
+#include "defs.h"
+#include "orientation.h"
+
+// A decoded image on its way from the decode workers through the prefetch
+// slots to the screen. Frames are immutable and reference counted, so handing
+// one over never copies pixels. The pixels are already in the format the
+// raster paint engine draws from (32-bit, premultiplied alpha).
+struct Frame
+{
+    QImage image;
+
+    // Decoded below full resolution
+    bool reduced = false;
+
+    // An embedded preview standing in until the full decode is done
+    bool preview = false;
+
+    // EXIF orientation, applied when the frame is scaled for display
+    Orientation orientation;
+
+    // 'image' scaled and turned for a window of 'displayViewport' device
+    // pixels, prepared ahead so that showing the frame needs no rescale
+    QImage display;
+    QSize displayViewport;
+};
+
+using FramePtr = std::shared_ptr<const Frame>;
+
+// Null if 'image' is null
+FramePtr makeFrame(QImage image);
+
+// Scales and turns the frame to fit a window of 'viewport' device pixels
+QImage scaleFrameForDisplay(const Frame& frame, const QSize& viewport, const Orientation& viewOrientation = Orientation());
+
+// A frame sharing the pixels of 'frame', with 'display' prepared for 'viewport'.
+// Null if 'frame' is null.
+FramePtr prepareDisplayFrame(const FramePtr& frame, const QSize& viewport);
+
+// decodeImage() plus the conversion to the display format, meant for worker
+// threads. Frames other igal processes decoded are mapped from shared memory
+// (see sharedframes.h), slow decodes are served from the pixel cache (see pixelcache.h).
+FramePtr decodeFrame(const fs_str_t& path, const QSize& targetSize = QSize());
+
+// The embedded JPEG preview of 'path' (see decodeEmbeddedPreview) as a frame
+// marked 'preview'. Null if the file has none.
+FramePtr decodePreviewFrame(const fs_str_t& path, const QSize& targetSize, size_t maxBytes);
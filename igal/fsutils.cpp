@@ -0,0 +1,80 @@
+#include "fsutils.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+
+QString fsstrToQstring(const fs_str_t& str)
+{
+    #if defined(WIN32) || defined(_WIN32)
+        return QString::fromStdWString(str);
+    #else
+        return QString::fromStdString(str);
+    #endif
+}
+
+fs_str_t qstringToFsstr(const QString& str)
+{
+    #if defined(WIN32) || defined(_WIN32)
+        return str.toStdWString();
+    #else
+        return str.toStdString();
+    #endif
+}
+
+fs_str_t fsStrToLower(const fs_str_t& src)
+{
+    return qstringToFsstr(fsstrToQstring(src).toLower());
+}
+
+fs_str_t getTargetDirectory(const fs_str_t& target)
+{
+    #if defined(WIN32) || defined(_WIN32)
+        return std::filesystem::path(target).remove_filename().wstring();
+    #else
+        return std::filesystem::path(target).remove_filename().string();
+    #endif
+}
+
+fs_str_t getTargetFilename(const fs_str_t& target)
+{
+    return std::filesystem::path(target).filename();
+}
+
+fs_str_t getTargetExtension(const fs_str_t& target)
+{
+    return fsStrToLower(std::filesystem::path(target).extension());
+}
+
+int fs_system(const fs_str_t& cmdline, bool background)
+{
+    #if defined(WIN32) || defined(_WIN32)
+        return execProc(cmdline, background);
+    #else
+        (void)background;
+        return system(cmdline.c_str());
+    #endif
+}
+
+std::string fs_system_output(const fs_str_t& cmdline)
+{
+    #if defined(WIN32) || defined(_WIN32)
+        return execProcOutput(cmdline);
+    #else
+        std::string result;
+        FILE* pipe = popen(cmdline.c_str(), "r");
+        if (!pipe)
+        {
+            return result;
+        }
+
+        char buff[4096];
+        size_t count;
+        while ((count = fread(buff, 1, sizeof(buff), pipe)) > 0)
+        {
+            result.append(buff, count);
+        }
+        pclose(pipe);
+        return result;
+    #endif
+}
\ No newline at end of file
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <QtCore/qstring.h>
+
+#include "defs.h"
+
+// Bullshit to deal with windows/linux handling of wstrings/utf-8 strings
+#if defined(WIN32) || defined(_WIN32) || defined(IGAL_PLATFORM_OVERRIDE_WIN32)
+    #include "win32/utils.h"
+    #define FSSTR(str) L##str
+    const fs_str_t DIR_SEPARATOR = FSSTR("\\");
+
+#elif defined(__linux__) || defined(__APPLE__) || defined(IGAL_PLATFORM_OVERRIDE_LINUX) || defined(IGAL_PLATFORM_OVERRIDE_MACOS)
+    #include "posix/utils.h"
+    #define FSSTR(str) str
+    const fs_str_t DIR_SEPARATOR = FSSTR("/");
+
+#else
+    #error "Unknown platform!"
+#endif
+
+QString fsstrToQstring(const fs_str_t& str);
+fs_str_t qstringToFsstr(const QString& str);
+fs_str_t fsStrToLower(const fs_str_t& src);
+
+fs_str_t getTargetDirectory(const fs_str_t& target);
+fs_str_t getTargetFilename(const fs_str_t& target);
+fs_str_t getTargetExtension(const fs_str_t& target);
+
+// Runs a command line without a console window. Returns 0 on success.
+// A 'background' process runs at idle priority (on POSIX it inherits the priority of the calling thread).
+int fs_system(const fs_str_t& cmdline, bool background = false);
+
+// Runs a command line and returns what it wrote to stdout
+std::string fs_system_output(const fs_str_t& cmdline);
\ No newline at end of file
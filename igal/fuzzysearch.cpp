@@ -0,0 +1,173 @@
+#include "fuzzysearch.h"
+
+#include <algorithm>
+#include <cwctype>
+#include <thread>
+
+// Below this many candidates, starting threads costs more than it saves
+const size_t FUZZY_MIN_ITEMS_PER_THREAD = 16 * 1024;
+
+const int FUZZY_SCORE_MATCH = 1;
+const int FUZZY_SCORE_CONSECUTIVE = 4;
+const int FUZZY_SCORE_WORD_START = 6;
+
+fs_str_t::value_type foldCase(fs_str_t::value_type c)
+{
+    if constexpr (sizeof(c) == 1)
+    {
+        return (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+    }
+    else
+    {
+        return static_cast<fs_str_t::value_type>(std::towlower(static_cast<wint_t>(c)));
+    }
+}
+
+bool isWordSeparator(fs_str_t::value_type c)
+{
+    return c == ' ' || c == '_' || c == '-' || c == '.' || c == '/' || c == '\\';
+}
+
+void FuzzySearch::setItems(const ItemList& items)
+{
+    names.clear();
+    offsets.assign(1, 0);
+    offsets.reserve(items.size() + 1);
+
+    for (size_t i = 0; i < items.size(); ++i)
+    {
+        for (auto c : items.getName(i))
+        {
+            names.push_back(foldCase(c));
+        }
+        offsets.push_back(static_cast<uint32_t>(names.size()));
+    }
+    levels.clear();
+}
+
+void FuzzySearch::setQuery(const fs_str_t& query)
+{
+    fs_str_t folded;
+    for (auto c : query)
+    {
+        folded.push_back(foldCase(c));
+    }
+
+    while (!levels.empty() && folded.compare(0, levels.back().query.size(), levels.back().query) != 0)
+    {
+        levels.pop_back();
+    }
+
+    if (folded.empty() || (!levels.empty() && levels.back().query == folded))
+    {
+        return;
+    }
+
+    auto matches = findMatches(folded, levels.empty() ? nullptr : &levels.back().matches);
+    levels.push_back({ std::move(folded), std::move(matches) });
+}
+
+size_t FuzzySearch::getMatchCount() const
+{
+    return levels.empty() ? offsets.size() - 1 : levels.back().matches.size();
+}
+
+std::vector<uint32_t> FuzzySearch::getTopMatches(size_t count) const
+{
+    std::vector<uint32_t> result;
+    if (levels.empty())
+    {
+        for (uint32_t i = 0; i + 1 < offsets.size() && result.size() < count; ++i)
+        {
+            result.push_back(i);
+        }
+        return result;
+    }
+
+    std::vector<Match> best = levels.back().matches;
+    auto end = best.begin() + std::min(count, best.size());
+    std::partial_sort(best.begin(), end, best.end(), [](const Match& a, const Match& b)
+    {
+        return a.score != b.score ? a.score > b.score : a.item < b.item;
+    });
+
+    for (auto it = best.begin(); it != end; ++it)
+    {
+        result.push_back(it->item);
+    }
+    return result;
+}
+
+std::vector<FuzzySearch::Match> FuzzySearch::findMatches(const fs_str_t& query, const std::vector<Match>* candidates) const
+{
+    size_t candidateCount = candidates ? candidates->size() : offsets.size() - 1;
+    size_t threadCount = std::clamp<size_t>(candidateCount / FUZZY_MIN_ITEMS_PER_THREAD, 1, std::max(1u, std::thread::hardware_concurrency()));
+    size_t chunkSize = (candidateCount + threadCount - 1) / threadCount;
+
+    // Every thread filters one contiguous chunk, so the concatenation stays in item order
+    std::vector<std::vector<Match>> partial(threadCount);
+    auto work = [&](size_t chunk)
+    {
+        size_t begin = chunk * chunkSize;
+        size_t end = std::min(candidateCount, begin + chunkSize);
+        for (size_t i = begin; i < end; ++i)
+        {
+            uint32_t item = candidates ? (*candidates)[i].item : static_cast<uint32_t>(i);
+            int score = getScore(item, query);
+            if (score >= 0)
+            {
+                partial[chunk].push_back({ item, score });
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t chunk = 1; chunk < threadCount; ++chunk)
+    {
+        threads.emplace_back(work, chunk);
+    }
+    work(0);
+    for (auto& t : threads)
+    {
+        t.join();
+    }
+
+    std::vector<Match> result = std::move(partial[0]);
+    for (size_t chunk = 1; chunk < threadCount; ++chunk)
+    {
+        result.insert(result.end(), partial[chunk].begin(), partial[chunk].end());
+    }
+    return result;
+}
+
+// Greedy left-to-right subsequence match, or -1. Matches at the start of a word
+// and runs of consecutive characters score higher.
+int FuzzySearch::getScore(size_t item, const fs_str_t& query) const
+{
+    const auto* name = names.data() + offsets[item];
+    size_t length = offsets[item + 1] - offsets[item];
+
+    int score = 0;
+    size_t q = 0;
+    size_t lastMatch = SIZE_MAX;
+    for (size_t i = 0; i < length && q < query.size(); ++i)
+    {
+        if (name[i] != query[q])
+        {
+            continue;
+        }
+
+        score += FUZZY_SCORE_MATCH;
+        if (i == 0 || isWordSeparator(name[i - 1]))
+        {
+            score += FUZZY_SCORE_WORD_START;
+        }
+        if (lastMatch != SIZE_MAX && lastMatch + 1 == i)
+        {
+            score += FUZZY_SCORE_CONSECUTIVE;
+        }
+        lastMatch = i;
+        ++q;
+    }
+    return q == query.size() ? score : -1;
+}
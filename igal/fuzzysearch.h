@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "defs.h"
+#include "itemlist.h"
+
+// Incremental fuzzy filename matching: the query characters have to appear in
+// the name in order, case-insensitively. Results are kept per query length, so
+// typing another character only filters the previous matches and deleting one
+// goes back to the results computed before.
+class FuzzySearch
+{
+public:
+    void setItems(const ItemList& items);
+    void setQuery(const fs_str_t& query);
+
+    size_t getMatchCount() const;
+
+    // Item indices of the best matches, best first
+    std::vector<uint32_t> getTopMatches(size_t count) const;
+
+private:
+    struct Match
+    {
+        uint32_t item;
+        int score;
+    };
+
+    struct Level
+    {
+        fs_str_t query;
+        std::vector<Match> matches;
+    };
+
+    std::vector<Match> findMatches(const fs_str_t& query, const std::vector<Match>* candidates) const;
+    int getScore(size_t item, const fs_str_t& query) const;
+
+    // Case-folded copy of every name, back to back
+    fs_str_t names;
+    std::vector<uint32_t> offsets;
+
+    std::vector<Level> levels;
+};
@@ -0,0 +1,7 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// XXH64 (https://github.com/Cyan4973/xxHash), non-cryptographic
+uint64_t xxHash64(const void* data, size_t size, uint64_t seed = 0);
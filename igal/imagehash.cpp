@@ -0,0 +1,351 @@
+#include "imagehash.h"
+
+#include <algorithm>
+#include <atomic>
+#include <bitset>
+#include <cstdio>
+#include <fstream>
+#include <numeric>
+#include <thread>
+#include <unordered_map>
+
+#include "cachestore.h"
+#include "decoder.h"
+#include "fsutils.h"
+#include "hash.h"
+#include "mediatypes.h"
+
+// Big enough for a stable 9x8 thumbnail, small enough for the largest JPEG DCT reduction
+const int HASH_DECODE_SIZE = 64;
+const int DHASH_WIDTH = 9;
+const int DHASH_HEIGHT = 8;
+
+const uint32_t HASH_INDEX_VERSION = 1;
+const fs_str_t HASH_INDEX_SUFFIX = FSSTR(".dhash");
+
+// Longer name lengths (PATH_MAX on Linux) only come from a corrupt index
+const uint32_t HASH_INDEX_MAX_NAME_LENGTH = 4096;
+
+// How many hashes are computed between progress reports
+const size_t HASH_PROGRESS_INTERVAL = 256;
+
+uint64_t computeDHash(const QImage& image)
+{
+    QImage thumb = image
+        .convertToFormat(QImage::Format_Grayscale8)
+        .scaled(DHASH_WIDTH, DHASH_HEIGHT, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+
+    uint64_t result = 0;
+    for (int y = 0; y < DHASH_HEIGHT; ++y)
+    {
+        const uint8_t* row = thumb.constScanLine(y);
+        for (int x = 0; x < DHASH_WIDTH - 1; ++x)
+        {
+            result = (result << 1) | (row[x] < row[x + 1] ? 1 : 0);
+        }
+    }
+    return result;
+}
+
+int getHammingDistance(uint64_t a, uint64_t b)
+{
+    return static_cast<int>(std::bitset<64>(a ^ b).count());
+}
+
+struct HashIndexEntry
+{
+    long long mtime = 0;
+    uint64_t size = 0;
+    uint64_t hash = 0;
+};
+
+fs_str_t getHashIndexPath(const fs_str_t& dir)
+{
+    auto dirHash = xxHash64(dir.data(), dir.size() * sizeof(fs_str_t::value_type));
+
+    char hex[17];
+    std::snprintf(hex, sizeof(hex), "%016llx", static_cast<unsigned long long>(dirHash));
+    return getCachePath(hex, HASH_INDEX_SUFFIX);
+}
+
+template<typename T>
+bool readValue(std::ifstream& ifs, T& value)
+{
+    return static_cast<bool>(ifs.read(reinterpret_cast<char*>(&value), sizeof(value)));
+}
+
+template<typename T>
+void writeValue(std::ofstream& ofs, const T& value)
+{
+    ofs.write(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+// Index format: version, entry count, then per entry the filename (length and
+// characters), mtime, size and hash. Anything unexpected discards the index.
+std::unordered_map<fs_str_t, HashIndexEntry> readHashIndex(const fs_str_t& path)
+{
+    std::unordered_map<fs_str_t, HashIndexEntry> result;
+    if (!useCacheFile(path))
+    {
+        return result;
+    }
+
+    std::ifstream ifs(path, std::ios::binary);
+    uint32_t version = 0;
+    uint64_t count = 0;
+    if (!readValue(ifs, version) || version != HASH_INDEX_VERSION || !readValue(ifs, count))
+    {
+        return result;
+    }
+
+    for (uint64_t i = 0; i < count; ++i)
+    {
+        uint32_t nameLength = 0;
+        if (!readValue(ifs, nameLength) || nameLength > HASH_INDEX_MAX_NAME_LENGTH)
+        {
+            return {};
+        }
+
+        fs_str_t name(nameLength, 0);
+        HashIndexEntry entry;
+        if (!ifs.read(reinterpret_cast<char*>(name.data()), nameLength * sizeof(fs_str_t::value_type))
+            || !readValue(ifs, entry.mtime)
+            || !readValue(ifs, entry.size)
+            || !readValue(ifs, entry.hash))
+        {
+            return {};
+        }
+        result.emplace(std::move(name), entry);
+    }
+    return result;
+}
+
+void writeHashIndex(const fs_str_t& path, const std::unordered_map<fs_str_t, HashIndexEntry>& index)
+{
+    auto tempPath = getCacheTempPath(path);
+    {
+        std::ofstream ofs(tempPath, std::ios::binary);
+        writeValue(ofs, HASH_INDEX_VERSION);
+        writeValue(ofs, static_cast<uint64_t>(index.size()));
+        for (const auto& [name, entry] : index)
+        {
+            writeValue(ofs, static_cast<uint32_t>(name.size()));
+            ofs.write(reinterpret_cast<const char*>(name.data()), name.size() * sizeof(fs_str_t::value_type));
+            writeValue(ofs, entry.mtime);
+            writeValue(ofs, entry.size);
+            writeValue(ofs, entry.hash);
+        }
+    }
+    commitCacheFile(tempPath, path);
+}
+
+std::vector<std::optional<uint64_t>> computeImageHashes(
+    const ItemList& items,
+    const ItemColumns& columns,
+    const std::function<void(size_t done, size_t total)>& onProgress)
+{
+    std::vector<std::optional<uint64_t>> result(items.size());
+
+    auto indexPath = getHashIndexPath(items.getDirectory());
+    auto index = readHashIndex(indexPath);
+
+    std::vector<size_t> missing;
+    for (size_t i = 0; i < items.size(); ++i)
+    {
+        if (!isImage(items[i]))
+        {
+            continue;
+        }
+
+        auto it = index.find(fs_str_t(items.getName(i)));
+        if (it != index.end() && it->second.mtime == columns.mtime[i] && it->second.size == columns.size[i])
+        {
+            result[i] = it->second.hash;
+        }
+        else
+        {
+            missing.push_back(i);
+        }
+    }
+
+    if (missing.empty())
+    {
+        return result;
+    }
+
+    // Work is handed out one item at a time: decode times vary a lot between formats
+    std::atomic<size_t> next = 0;
+    std::atomic<size_t> done = 0;
+    size_t threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < threadCount; ++t)
+    {
+        threads.emplace_back([&]()
+        {
+            for (size_t i = next++; i < missing.size(); i = next++)
+            {
+                size_t item = missing[i];
+                QImage image = decodeImage(items[item], QSize(HASH_DECODE_SIZE, HASH_DECODE_SIZE));
+                if (!image.isNull())
+                {
+                    result[item] = computeDHash(image);
+                }
+
+                size_t count = ++done;
+                if (onProgress && count % HASH_PROGRESS_INTERVAL == 0)
+                {
+                    onProgress(count, missing.size());
+                }
+            }
+        });
+    }
+
+    for (auto& t : threads)
+    {
+        t.join();
+    }
+
+    // Entries of files no longer in the directory are dropped with the rewrite
+    std::unordered_map<fs_str_t, HashIndexEntry> newIndex;
+    for (size_t i = 0; i < items.size(); ++i)
+    {
+        if (result[i])
+        {
+            newIndex.emplace(items.getName(i), HashIndexEntry{ columns.mtime[i], columns.size[i], *result[i] });
+        }
+    }
+    writeHashIndex(indexPath, newIndex);
+
+    return result;
+}
+
+// Metric tree over Hamming distance: a node's children are keyed by their
+// distance to it, so a radius query skips every subtree outside the triangle inequality
+class BkTree
+{
+public:
+    void insert(uint64_t hash, uint32_t id)
+    {
+        if (nodes.empty())
+        {
+            nodes.push_back({ hash, id, {} });
+            return;
+        }
+
+        size_t current = 0;
+        while (true)
+        {
+            int distance = getHammingDistance(hash, nodes[current].hash);
+            auto& children = nodes[current].children;
+            auto child = std::find_if(children.begin(), children.end(), [&](const auto& c) { return c.first == distance; });
+            if (child == children.end())
+            {
+                children.emplace_back(distance, static_cast<uint32_t>(nodes.size()));
+                nodes.push_back({ hash, id, {} });
+                return;
+            }
+            current = child->second;
+        }
+    }
+
+    void query(uint64_t hash, int maxDistance, std::vector<uint32_t>& result) const
+    {
+        if (nodes.empty())
+        {
+            return;
+        }
+
+        std::vector<uint32_t> stack = { 0 };
+        while (!stack.empty())
+        {
+            const Node& node = nodes[stack.back()];
+            stack.pop_back();
+
+            int distance = getHammingDistance(hash, node.hash);
+            if (distance <= maxDistance)
+            {
+                result.push_back(node.id);
+            }
+
+            for (const auto& [childDistance, child] : node.children)
+            {
+                if (childDistance >= distance - maxDistance && childDistance <= distance + maxDistance)
+                {
+                    stack.push_back(child);
+                }
+            }
+        }
+    }
+
+private:
+    struct Node
+    {
+        uint64_t hash;
+        uint32_t id;
+        std::vector<std::pair<int, uint32_t>> children;
+    };
+
+    std::vector<Node> nodes;
+};
+
+uint32_t findRoot(std::vector<uint32_t>& parents, uint32_t id)
+{
+    while (parents[id] != id)
+    {
+        parents[id] = parents[parents[id]];
+        id = parents[id];
+    }
+    return id;
+}
+
+std::vector<std::vector<uint32_t>> findDuplicateGroups(const std::vector<std::optional<uint64_t>>& hashes, int maxDistance)
+{
+    BkTree tree;
+    for (uint32_t i = 0; i < hashes.size(); ++i)
+    {
+        if (hashes[i])
+        {
+            tree.insert(*hashes[i], i);
+        }
+    }
+
+    std::vector<uint32_t> parents(hashes.size());
+    std::iota(parents.begin(), parents.end(), 0);
+
+    std::vector<uint32_t> matches;
+    for (uint32_t i = 0; i < hashes.size(); ++i)
+    {
+        if (!hashes[i])
+        {
+            continue;
+        }
+
+        matches.clear();
+        tree.query(*hashes[i], maxDistance, matches);
+        for (uint32_t match : matches)
+        {
+            parents[findRoot(parents, match)] = findRoot(parents, i);
+        }
+    }
+
+    std::unordered_map<uint32_t, size_t> groupOfRoot;
+    std::vector<std::vector<uint32_t>> groups;
+    for (uint32_t i = 0; i < hashes.size(); ++i)
+    {
+        if (!hashes[i])
+        {
+            continue;
+        }
+
+        auto [it, inserted] = groupOfRoot.emplace(findRoot(parents, i), groups.size());
+        if (inserted)
+        {
+            groups.emplace_back();
+        }
+        groups[it->second].push_back(i);
+    }
+
+    groups.erase(std::remove_if(groups.begin(), groups.end(), [](const auto& g) { return g.size() < 2; }), groups.end());
+    return groups;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <vector>
+
+#include <QtGui/qimage.h>
+
+#include "defs.h"
+#include "itemcolumns.h"
+#include "itemlist.h"
+
+// 64-bit difference hash: brightness gradients of a 9x8 grayscale thumbnail.
+// Re-saves, recompressions and resized copies end up a few bits apart.
+uint64_t computeDHash(const QImage& image);
+
+int getHammingDistance(uint64_t a, uint64_t b);
+
+// Perceptual hashes of every still image of a directory listing (nullopt for
+// anything else). Decodes run in parallel at reduced resolution, and the
+// results are kept in a per-directory index in the cache store, so only new
+// or modified files are hashed again.
+std::vector<std::optional<uint64_t>> computeImageHashes(
+    const ItemList& items,
+    const ItemColumns& columns,
+    const std::function<void(size_t done, size_t total)>& onProgress);
+
+// Groups of item indices whose hashes are at most 'maxDistance' bits apart,
+// each in item order, ordered by their first item. Singletons are left out.
+std::vector<std::vector<uint32_t>> findDuplicateGroups(const std::vector<std::optional<uint64_t>>& hashes, int maxDistance);
@@ -0,0 +1,210 @@
+#include "itemcolumns.h"
+
+#include <algorithm>
+#include <cwctype>
+#include <numeric>
+#include <thread>
+
+#include "exif.h"
+
+void ItemColumns::reserve(size_t count)
+{
+    mtime.reserve(count);
+    size.reserve(count);
+    type.reserve(count);
+    captureTime.reserve(count);
+}
+
+void ItemColumns::push(long long itemMtime, uint64_t itemSize, uint8_t itemType)
+{
+    mtime.push_back(itemMtime);
+    size.push_back(itemSize);
+    type.push_back(itemType);
+    captureTime.push_back(CAPTURE_TIME_UNREAD);
+}
+
+bool ItemColumns::hasCaptureTimes() const
+{
+    return std::none_of(captureTime.begin(), captureTime.end(), [](long long t) { return t == CAPTURE_TIME_UNREAD; });
+}
+
+const char* getSortOrderName(SortOrder order)
+{
+    switch (order)
+    {
+    case SortOrder::Modified:
+        return "Date modified";
+    case SortOrder::Name:
+        return "Name";
+    case SortOrder::Size:
+        return "Size";
+    case SortOrder::Type:
+        return "Type";
+    case SortOrder::Captured:
+        return "Date taken";
+    default:
+        return "";
+    }
+}
+
+SortOrder getNextSortOrder(SortOrder order)
+{
+    return static_cast<SortOrder>((static_cast<int>(order) + 1) % static_cast<int>(SortOrder::Count));
+}
+
+bool isDigit(fs_str_t::value_type c)
+{
+    return c >= '0' && c <= '9';
+}
+
+int naturalCompare(fs_strview_t a, fs_strview_t b)
+{
+    size_t i = 0;
+    size_t j = 0;
+    while (i < a.size() && j < b.size())
+    {
+        if (isDigit(a[i]) && isDigit(b[j]))
+        {
+            while (i < a.size() && a[i] == '0') { ++i; }
+            while (j < b.size() && b[j] == '0') { ++j; }
+
+            size_t numStartA = i;
+            size_t numStartB = j;
+            while (i < a.size() && isDigit(a[i])) { ++i; }
+            while (j < b.size() && isDigit(b[j])) { ++j; }
+
+            size_t lenA = i - numStartA;
+            size_t lenB = j - numStartB;
+            if (lenA != lenB)
+            {
+                return lenA < lenB ? -1 : 1;
+            }
+
+            int cmp = a.compare(numStartA, lenA, b, numStartB, lenB);
+            if (cmp != 0)
+            {
+                return cmp;
+            }
+            continue;
+        }
+
+        auto ca = std::towlower(static_cast<wint_t>(a[i]));
+        auto cb = std::towlower(static_cast<wint_t>(b[j]));
+        if (ca != cb)
+        {
+            return ca < cb ? -1 : 1;
+        }
+        ++i;
+        ++j;
+    }
+
+    if (i == a.size() && j == b.size())
+    {
+        return a.compare(b);
+    }
+    return i == a.size() ? -1 : 1;
+}
+
+std::vector<long long> readCaptureTimes(const ItemList& items)
+{
+    std::vector<long long> result(items.size(), -1);
+
+    size_t threadCount = std::max(1u, std::thread::hardware_concurrency());
+    size_t chunkSize = (items.size() + threadCount - 1) / threadCount;
+
+    std::vector<std::thread> threads;
+    for (size_t begin = 0; begin < items.size(); begin += chunkSize)
+    {
+        size_t end = std::min(items.size(), begin + chunkSize);
+        threads.emplace_back([&, begin, end]()
+        {
+            for (size_t i = begin; i < end; ++i)
+            {
+                result[i] = readExifCaptureTime(items.getPath(i));
+            }
+        });
+    }
+
+    for (auto& t : threads)
+    {
+        t.join();
+    }
+    return result;
+}
+
+std::vector<uint32_t> getSortedItemOrder(const ItemList& items, const ItemColumns& columns, SortOrder order)
+{
+    std::vector<uint32_t> result(items.size());
+    std::iota(result.begin(), result.end(), 0);
+
+    auto byName = [&](uint32_t a, uint32_t b) { return naturalCompare(items.getName(a), items.getName(b)) < 0; };
+
+    switch (order)
+    {
+    case SortOrder::Modified:
+        std::sort(result.begin(), result.end(), [&](uint32_t a, uint32_t b)
+        {
+            return columns.mtime[a] != columns.mtime[b] ? columns.mtime[a] > columns.mtime[b] : a < b;
+        });
+        break;
+
+    case SortOrder::Name:
+        std::sort(result.begin(), result.end(), byName);
+        break;
+
+    case SortOrder::Size:
+        std::sort(result.begin(), result.end(), [&](uint32_t a, uint32_t b)
+        {
+            return columns.size[a] != columns.size[b] ? columns.size[a] > columns.size[b] : byName(a, b);
+        });
+        break;
+
+    case SortOrder::Type:
+        std::sort(result.begin(), result.end(), [&](uint32_t a, uint32_t b)
+        {
+            return columns.type[a] != columns.type[b] ? columns.type[a] < columns.type[b] : byName(a, b);
+        });
+        break;
+
+    case SortOrder::Captured:
+        // Items without a capture date go last, newest modification first
+        std::sort(result.begin(), result.end(), [&](uint32_t a, uint32_t b)
+        {
+            bool hasA = columns.captureTime[a] >= 0;
+            bool hasB = columns.captureTime[b] >= 0;
+            if (hasA != hasB)
+            {
+                return hasA;
+            }
+            const auto& keys = hasA ? columns.captureTime : columns.mtime;
+            return keys[a] != keys[b] ? keys[a] > keys[b] : a < b;
+        });
+        break;
+
+    default:
+        break;
+    }
+
+    return result;
+}
+
+template<typename T>
+void permute(std::vector<T>& values, const std::vector<uint32_t>& order)
+{
+    std::vector<T> result;
+    result.reserve(values.size());
+    for (uint32_t idx : order)
+    {
+        result.push_back(std::move(values[idx]));
+    }
+    values = std::move(result);
+}
+
+void applyItemOrder(ItemList& items, ItemColumns& columns, const std::vector<uint32_t>& order)
+{
+    items.applyOrder(order);
+    permute(columns.mtime, order);
+    permute(columns.size, order);
+    permute(columns.type, order);
+    permute(columns.captureTime, order);
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "defs.h"
+#include "itemlist.h"
+
+enum class SortOrder
+{
+    Modified,
+    Name,
+    Size,
+    Type,
+    Captured,
+
+    Count
+};
+
+const long long CAPTURE_TIME_UNREAD = -2;
+
+// Per-item sort keys, stored column-wise in parallel to the item list
+struct ItemColumns
+{
+    std::vector<long long> mtime;
+    std::vector<uint64_t> size;
+    std::vector<uint8_t> type;
+    std::vector<long long> captureTime;
+
+    void reserve(size_t count);
+    void push(long long itemMtime, uint64_t itemSize, uint8_t itemType);
+
+    bool hasCaptureTimes() const;
+};
+
+const char* getSortOrderName(SortOrder order);
+SortOrder getNextSortOrder(SortOrder order);
+
+// Natural ("file2" < "file10"), case-insensitive string comparison
+int naturalCompare(fs_strview_t a, fs_strview_t b);
+
+std::vector<long long> readCaptureTimes(const ItemList& items);
+
+// Returns the item indices in display order for the given sort key
+std::vector<uint32_t> getSortedItemOrder(const ItemList& items, const ItemColumns& columns, SortOrder order);
+
+// Permutes the item list and every column by 'order' (as returned by getSortedItemOrder)
+void applyItemOrder(ItemList& items, ItemColumns& columns, const std::vector<uint32_t>& order);
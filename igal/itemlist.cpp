@@ -0,0 +1,133 @@
+#include "itemlist.h"
+
+#include <algorithm>
+
+#include "fsutils.h"
+#include "hash.h"
+
+// The hash index is kept at most half full, so probe sequences stay short
+const size_t ITEM_INDEX_MIN_CAPACITY = 64;
+
+void ItemList::setDirectory(const fs_str_t& dir)
+{
+    directory = dir;
+    if (!directory.empty() && directory.back() != DIR_SEPARATOR.back())
+    {
+        directory += DIR_SEPARATOR;
+    }
+}
+
+void ItemList::reserve(size_t count, size_t nameChars)
+{
+    arena.reserve(nameChars);
+    offsets.reserve(count + 1);
+
+    size_t capacity = ITEM_INDEX_MIN_CAPACITY;
+    while (capacity < count * 2)
+    {
+        capacity *= 2;
+    }
+    if (capacity > index.size())
+    {
+        rebuildIndex(capacity);
+    }
+}
+
+void ItemList::push(fs_strview_t name)
+{
+    arena.append(name);
+    offsets.push_back(static_cast<uint32_t>(arena.size()));
+
+    if (size() * 2 > index.size())
+    {
+        rebuildIndex(std::max(ITEM_INDEX_MIN_CAPACITY, index.size() * 2));
+    }
+    else
+    {
+        insertIndex(static_cast<uint32_t>(size() - 1));
+    }
+}
+
+void ItemList::clear()
+{
+    arena.clear();
+    offsets.assign(1, 0);
+    index.clear();
+}
+
+fs_strview_t ItemList::getName(size_t idx) const
+{
+    return fs_strview_t(arena).substr(offsets[idx], offsets[idx + 1] - offsets[idx]);
+}
+
+fs_str_t ItemList::getPath(size_t idx) const
+{
+    fs_str_t result;
+    auto name = getName(idx);
+    result.reserve(directory.size() + name.size());
+    result.append(directory);
+    result.append(name);
+    return result;
+}
+
+size_t ItemList::find(const fs_str_t& path) const
+{
+    if (index.empty() || path.compare(0, directory.size(), directory) != 0)
+    {
+        return size();
+    }
+
+    auto name = fs_strview_t(path).substr(directory.size());
+    size_t mask = index.size() - 1;
+    for (size_t slot = hashName(name) & mask; index[slot] != 0; slot = (slot + 1) & mask)
+    {
+        if (getName(index[slot] - 1) == name)
+        {
+            return index[slot] - 1;
+        }
+    }
+    return size();
+}
+
+void ItemList::applyOrder(const std::vector<uint32_t>& order)
+{
+    fs_str_t newArena;
+    std::vector<uint32_t> newOffsets = { 0 };
+    newArena.reserve(arena.size());
+    newOffsets.reserve(order.size() + 1);
+
+    for (uint32_t idx : order)
+    {
+        newArena.append(getName(idx));
+        newOffsets.push_back(static_cast<uint32_t>(newArena.size()));
+    }
+
+    arena = std::move(newArena);
+    offsets = std::move(newOffsets);
+    rebuildIndex(index.size());
+}
+
+uint64_t ItemList::hashName(fs_strview_t name) const
+{
+    return xxHash64(name.data(), name.size() * sizeof(fs_strview_t::value_type));
+}
+
+void ItemList::insertIndex(uint32_t idx)
+{
+    size_t mask = index.size() - 1;
+    size_t slot = hashName(getName(idx)) & mask;
+    while (index[slot] != 0)
+    {
+        slot = (slot + 1) & mask;
+    }
+    index[slot] = idx + 1;
+}
+
+void ItemList::rebuildIndex(size_t capacity)
+{
+    index.assign(std::max(capacity, ITEM_INDEX_MIN_CAPACITY), 0);
+    for (uint32_t i = 0; i < size(); ++i)
+    {
+        insertIndex(i);
+    }
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "defs.h"
+
+// Items of a single directory. Filenames are stored back to back in one arena
+// and addressed by offset; the directory prefix is kept once. A hash table from
+// filename to position makes lookups O(1). Overhead is about 12 bytes per item
+// on top of the filename itself.
+class ItemList
+{
+public:
+    void setDirectory(const fs_str_t& dir);
+    const fs_str_t& getDirectory() const { return directory; }
+
+    void reserve(size_t count, size_t nameChars);
+    void push(fs_strview_t name);
+    void clear();
+
+    size_t size() const { return offsets.size() - 1; }
+    bool empty() const { return size() == 0; }
+
+    fs_strview_t getName(size_t idx) const;
+
+    // Full path of an item
+    fs_str_t getPath(size_t idx) const;
+    fs_str_t operator[](size_t idx) const { return getPath(idx); }
+
+    // Position of the item with the given full path, or size() if it isn't listed
+    size_t find(const fs_str_t& path) const;
+
+    // Reorders the items by 'order' (as returned by getSortedItemOrder). Items not in 'order' are dropped.
+    void applyOrder(const std::vector<uint32_t>& order);
+
+private:
+    uint64_t hashName(fs_strview_t name) const;
+    void insertIndex(uint32_t idx);
+    void rebuildIndex(size_t capacity);
+
+    fs_str_t directory;
+    fs_str_t arena;
+    std::vector<uint32_t> offsets = { 0 };
+
+    // Open addressing with linear probing, power of two sized. Slots hold item index + 1, 0 is empty.
+    std::vector<uint32_t> index;
+};
@@ -1,11 +1,173 @@
+#include <QtCore/qabstracteventdispatcher.h>
+#include <QtCore/qsize.h>
+#include <QtCore/qtimer.h>
+
+#include <QtGui/qguiapplication.h>
+
 #include <QtWidgets/qapplication.h>
 
+#include <filesystem>
 #include <iostream>
+#include <iterator>
+#include <memory>
+#include <vector>
 
+#include "contactsheet.h"
 #include "defs.h"
+#include "fsutils.h"
 #include "mainwindow.h"
+#include "singleinstance.h"
+#include "warm.h"
+
+const int WAKEUP_TRACE_INTERVAL_MS = 10000;
+
+// The size the viewer window opens at (mainwindow.ui), which its first decodes are made for
+const QSize WARM_DEFAULT_DISPLAY_SIZE(800, 600);
+
+struct LaunchOptions
+{
+    fs_str_t target;
+    bool resident = false;
+    bool warm = false;
+    bool recursive = false;
+    QSize warmDisplaySize = WARM_DEFAULT_DISPLAY_SIZE;
+
+    fs_str_t contactSheetPath;
+    ContactSheetLayout contactSheetLayout;
+};
+
+int mainBody(int argc, const LaunchOptions& options);
+
+// Reads the value following a '--name value' option
+bool readOptionValue(const std::vector<fs_str_t>& args, size_t& i, fs_str_t& value)
+{
+    if (i + 1 >= args.size())
+    {
+        std::cerr << "Missing value for " << qPrintable(fsstrToQstring(args[i])) << "\n";
+        return false;
+    }
+    value = args[++i];
+    return true;
+}
+
+bool readOptionValue(const std::vector<fs_str_t>& args, size_t& i, int& value)
+{
+    fs_str_t text;
+    if (!readOptionValue(args, i, text))
+    {
+        return false;
+    }
 
-int mainBody(int argc, const fs_str_t& target);
+    bool ok = false;
+    value = fsstrToQstring(text).toInt(&ok);
+    if (!ok)
+    {
+        std::cerr << "Not a number: " << qPrintable(fsstrToQstring(text)) << "\n";
+    }
+    return ok;
+}
+
+// "1920x1080"
+bool readOptionValue(const std::vector<fs_str_t>& args, size_t& i, QSize& value)
+{
+    fs_str_t text;
+    if (!readOptionValue(args, i, text))
+    {
+        return false;
+    }
+
+    auto parts = fsstrToQstring(text).split('x');
+    bool widthOk = false;
+    bool heightOk = false;
+    if (parts.size() == 2)
+    {
+        value = QSize(parts[0].toInt(&widthOk), parts[1].toInt(&heightOk));
+    }
+    if (!widthOk || !heightOk || value.isEmpty())
+    {
+        std::cerr << "Not a size: " << qPrintable(fsstrToQstring(text)) << "\n";
+        return false;
+    }
+    return true;
+}
+
+bool parseArgs(const std::vector<fs_str_t>& args, LaunchOptions& options)
+{
+    for (size_t i = 0; i < args.size(); ++i)
+    {
+        const auto& arg = args[i];
+        if (arg == FSSTR("--contact-sheet"))
+        {
+            if (!readOptionValue(args, i, options.contactSheetPath))
+            {
+                return false;
+            }
+        }
+        else if (arg == FSSTR("--columns") || arg == FSSTR("--rows") || arg == FSSTR("--tile"))
+        {
+            auto& layout = options.contactSheetLayout;
+            int& value = arg == FSSTR("--columns") ? layout.columns : arg == FSSTR("--rows") ? layout.rows : layout.tileSize;
+            if (!readOptionValue(args, i, value))
+            {
+                return false;
+            }
+        }
+        else if (arg == FSSTR("--resident"))
+        {
+            options.resident = true;
+        }
+        else if (arg == FSSTR("--warm"))
+        {
+            options.warm = true;
+        }
+        else if (arg == FSSTR("--recursive"))
+        {
+            options.recursive = true;
+        }
+        else if (arg == FSSTR("--display-size"))
+        {
+            if (!readOptionValue(args, i, options.warmDisplaySize))
+            {
+                return false;
+            }
+        }
+        else if (options.target.empty())
+        {
+            options.target = arg;
+        }
+    }
+
+    if (options.target.empty())
+    {
+        std::cerr << "No target argument provided!\n";
+        return false;
+    }
+    return true;
+}
+
+// Periodically reports how often the UI event loop woke up (and, where /proc is
+// available, how many threads are alive). Left idle, both should stay flat.
+void traceWakeups(QCoreApplication& app)
+{
+    auto wakeups = std::make_shared<size_t>(0);
+    QObject::connect(QAbstractEventDispatcher::instance(), &QAbstractEventDispatcher::awake, [wakeups]() { ++*wakeups; });
+
+    auto* timer = new QTimer(&app);
+    QObject::connect(timer, &QTimer::timeout, [wakeups]()
+    {
+        std::cerr << "Event loop wakeups in the last " << WAKEUP_TRACE_INTERVAL_MS / 1000 << " s: " << *wakeups;
+
+        std::error_code ec;
+        std::filesystem::directory_iterator tasks("/proc/self/task", ec);
+        if (!ec)
+        {
+            std::cerr << ", threads: " << std::distance(tasks, std::filesystem::directory_iterator());
+        }
+        std::cerr << "\n";
+        *wakeups = 0;
+    });
+    timer->start(WAKEUP_TRACE_INTERVAL_MS);
+}
 
 #if defined(WIN32) || defined(_WIN32)
 
@@ -20,38 +182,72 @@ int WINAPI wWinMain(
     int argc;
     LPWSTR* argv = CommandLineToArgvW(lpCmdLine, &argc);
 
-    if (argc < 1)
+    LaunchOptions options;
+    if (!parseArgs(std::vector<fs_str_t>(argv, argv + argc), options))
     {
-        std::cerr << "No target argument provided!\n";
         return 1;
     }
-
-    fs_str_t target(argv[0]);
-    return mainBody(argc, target);
+    return mainBody(argc, options);
 }
 
 #else
 
 int main(int argc, char** argv)
 {
-    if (argc < 2)
+    LaunchOptions options;
+    if (!parseArgs(std::vector<fs_str_t>(argv + 1, argv + argc), options))
     {
-        std::cerr << "No target argument provided!\n";
         return 1;
     }
-
-    fs_str_t target(argv[1]);
-    return mainBody(argc, target);
+    return mainBody(argc, options);
 }
 
 #endif
 
-int mainBody(int argc, const fs_str_t& target)
+int mainBody(int argc, const LaunchOptions& options)
 {
+    fs_str_t target = std::filesystem::absolute(options.target).native();
+
+    if (options.warm)
+    {
+        // No window is ever created, so this also runs without a display (e.g. from cron)
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+        QGuiApplication app(argc, nullptr);
+        return runWarmMode(target, options.recursive, options.warmDisplaySize);
+    }
+
+    if (!options.contactSheetPath.empty())
+    {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+        QGuiApplication app(argc, nullptr);
+        fs_str_t outputPath = std::filesystem::absolute(options.contactSheetPath).native();
+        return runContactSheetMode(target, outputPath, options.contactSheetLayout);
+    }
+
     QApplication app(argc, nullptr);
 
+    if (qEnvironmentVariableIsSet("IGAL_TRACE_WAKEUPS"))
+    {
+        traceWakeups(app);
+    }
+
+    // A resident instance keeps its item list and decoded images warm: hand the target over
+    if (options.resident && sendToRunningInstance(target))
+    {
+        return 0;
+    }
+
     MainWindow win(target);
+
+    std::unique_ptr<InstanceServer> instanceServer;
+    if (options.resident)
+    {
+        app.setQuitOnLastWindowClosed(false);
+        win.setResident(true);
+        instanceServer = std::make_unique<InstanceServer>([&](const fs_str_t& newTarget) { win.openTarget(newTarget); });
+    }
+
     win.show();
 
     return app.exec();
-}
\ No newline at end of file
+}
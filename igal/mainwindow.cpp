@@ -1,50 +1,72 @@
 #include "mainwindow.h"
 
+#include "archive.h"
+#include "cachestore.h"
+#include "contactsheet.h"
+#include "exif.h"
+#include "frame.h"
+#include "fsutils.h"
+#include "imagehash.h"
+#include "mediatypes.h"
+#include "transcode.h"
+
 #include <QtCore/qdir.h>
+#include <QtCore/qelapsedtimer.h>
 
 #include <QtGui/qevent.h>
+#include <QtGui/qscreen.h>
+#include <QtGui/qwindow.h>
 
 #include <QtMultimedia/qmediacontent.h>
 
+#include <QtWidgets/qapplication.h>
+#include <QtWidgets/qfiledialog.h>
 #include <QtWidgets/qmessagebox.h>
 
+#include <algorithm>
 #include <chrono>
 #include <cstdlib>
 #include <filesystem>
 #include <fstream>
-#include <map>
+#include <iostream>
 #include <sstream>
 #include <string>
 #include <thread>
 #include <unordered_set>
 
-// Bullshit to deal with windows/linux handling of wstrings/utf-8 strings
-#if defined(WIN32) || defined(_WIN32) || defined(IGAL_PLATFORM_OVERRIDE_WIN32)
-    #include "win32/utils.h"
-    #define FSSTR(str) L##str
-    const fs_str_t DIR_SEPARATOR = FSSTR("\\");
+const fs_str_t LINKS_FILE = FSSTR("links.txt");
 
-#elif defined(__linux__) || defined(__APPLE__) || defined(IGAL_PLATFORM_OVERRIDE_LINUX) || defined(IGAL_PLATFORM_OVERRIDE_MACOS)
-    #include "posix/utils.h"
-    #define FSSTR(str) str
-    const fs_str_t DIR_SEPARATOR = FSSTR("/");
+const size_t READAHEAD_MAX_ITEMS = 32;
+const int MULTIMEDIA_WARMUP_DELAY_MS = 300;
 
-#else
-    #error "Unknown platform!"
-#endif
+const int VIDEO_INFO_INTERVAL_MS = 100;
+const int TIP_DURATION_MS = 750;
 
-const fs_str_t CACHE_DIR = FSSTR(".igal_cache");
-const fs_str_t OS_VID_FMT = FSSTR(".mp4");
-const fs_str_t LINKS_FILE = FSSTR("links.txt");
+// Held-down navigation shows previews decoded at this fraction of the window size
+const int NAVIGATION_PREVIEW_SCALE = 4;
 
-QString fsstrToQstring(const fs_str_t& str)
-{
-    #if defined(WIN32) || defined(_WIN32)
-        return QString::fromStdWString(str);
-    #else
-        return QString::fromStdString(str);
-    #endif
-}
+// JPEGs this large (and all RAW files) show their embedded preview while the full decode runs
+const uintmax_t EMBEDDED_PREVIEW_MIN_FILE_SIZE = 8 * 1024 * 1024;
+const size_t EMBEDDED_PREVIEW_MAX_BYTES = 1024 * 1024;
+
+// Out of 64 bits: re-saves and resized copies, but not merely similar pictures
+const int DUPLICATE_MAX_DISTANCE = 8;
+
+const size_t SEARCH_MAX_RESULTS = 10;
+
+const qint64 KEYFRAME_SNAP_TOLERANCE_MS = 1500;
+const int SEEK_PREVIEW_SCALE = 2;
+const int SEEK_PREVIEW_MARGIN = 24;
+const int SEEK_PREVIEW_HIDE_MS = 800;
+
+// Frames kept around the playhead for stepping, within this many bytes
+const size_t FRAME_RING_BYTES = 384 * 1024 * 1024;
+const size_t FRAME_RING_MIN_FRAMES = 16;
+const size_t FRAME_RING_MAX_FRAMES = 512;
+
+// Frames decoded per ffmpeg run at least, and how close to the end of the ring the next run starts
+const qint64 FRAME_STEP_MIN_BATCH = 12;
+const qint64 FRAME_STEP_PREFETCH_MARGIN = 8;
 
 void debugMessageBox(QString title, QString text)
 {
@@ -59,67 +81,6 @@ fs_str_t getExecutableDir()
     return getExeDir();
 }
 
-fs_str_t qstringToFsstr(const QString& str)
-{
-    #if defined(WIN32) || defined(_WIN32)
-        return str.toStdWString();
-    #else
-        return str.toStdString();
-    #endif
-}
-
-void fs_system(const fs_str_t& cmdline)
-{
-    #if defined(WIN32) || defined(_WIN32)
-        execProc(cmdline);
-    #else
-        system(cmdline.c_str());
-    #endif
-}
-
-const std::unordered_set<fs_str_t> imageExtensions = {
-    FSSTR(".jpg"),
-    FSSTR(".jpeg"),
-    FSSTR(".png"),
-    FSSTR(".tga"),
-    FSSTR(".tiff"),
-    FSSTR(".webp")
-};
-
-const std::unordered_set<fs_str_t> animationExtensions = {
-    FSSTR(".png"),
-    FSSTR(".gif")
-};
-
-const std::unordered_set<fs_str_t> videoExtensions = {
-    FSSTR(".avi"),
-    FSSTR(".m4v"),
-    FSSTR(".mp4"),
-    FSSTR(".webm"),
-
-#if defined(WIN32) || defined(_WIN32)
-    FSSTR(".wmv"),
-#endif
-};
-
-std::unordered_set<fs_str_t> getValidExtensions()
-{
-    std::unordered_set<fs_str_t> result;
-
-    std::copy(imageExtensions.begin(), imageExtensions.end(), std::inserter(result, result.begin()));
-    std::copy(animationExtensions.begin(), animationExtensions.end(), std::inserter(result, result.begin()));
-    std::copy(videoExtensions.begin(), videoExtensions.end(), std::inserter(result, result.begin()));
-
-    return result;
-}
-
-const std::unordered_set<fs_str_t> validExtensions = getValidExtensions();
-
-fs_str_t fsStrToLower(const fs_str_t& src)
-{
-    return qstringToFsstr(fsstrToQstring(src).toLower());
-}
-
 size_t genLargeRand()
 {
     size_t result = 0;
@@ -130,31 +91,30 @@ size_t genLargeRand()
     return result & 0xFFFFFFFFFFFFFFFFull;
 }
 
-fs_str_t getTargetDirectory(const fs_str_t& target)
+bool isWorthEmbeddedPreview(const fs_str_t& path, uintmax_t fileSize)
 {
-    #if defined(WIN32) || defined(_WIN32)
-        return std::filesystem::path(target).remove_filename().wstring();
-    #else
-        return std::filesystem::path(target).remove_filename().string();
-    #endif
-}
+    if (isRawImage(path))
+    {
+        return true;
+    }
 
-fs_str_t getTargetFilename(const fs_str_t& target)
-{
-    return std::filesystem::path(target).filename();
-}
+    fs_str_t ext = getTargetExtension(path);
+    if (ext != FSSTR(".jpg") && ext != FSSTR(".jpeg"))
+    {
+        return false;
+    }
 
-fs_str_t getTargetExtension(const fs_str_t& target)
-{
-    return fsStrToLower(std::filesystem::path(target).extension());
+    return fileSize >= EMBEDDED_PREVIEW_MIN_FILE_SIZE;
 }
 
 MainWindow::MainWindow(const fs_str_t& target, QWidget* parent) :
     QMainWindow(parent),
     ui(std::make_unique<Ui::MainWindow>()),
-    target(target),
-    currentDir(getTargetDirectory(target))
+    target(resolveArchiveTarget(target)),
+    currentDir(getBrowseDirectory(this->target))
 {
+    startupTimer.start();
+
     ui->setupUi(this);
     resizeTimer.setSingleShot(true);
     connect(&resizeTimer, SIGNAL(timeout()), SLOT(resizeEnd()));
@@ -163,10 +123,6 @@ MainWindow::MainWindow(const fs_str_t& target, QWidget* parent) :
 
     srand(std::chrono::system_clock::now().time_since_epoch().count());
 
-    player = std::make_unique<QMediaPlayer>();
-    playlist = std::make_unique<QMediaPlaylist>(player.get());
-    video = std::make_unique<QVideoWidget>();
-
     QFont videoInfoFont("Courier New");
     videoInfoFont.setBold(true);
     videoInfoFont.setPixelSize(12);
@@ -179,15 +135,52 @@ MainWindow::MainWindow(const fs_str_t& target, QWidget* parent) :
 
     videoInfoFontMetrics = std::make_unique<QFontMetrics>(videoInfoLabel->fontMetrics());
 
-    centralWidget()->layout()->addWidget(video.get());
-    video->setContentsMargins(0, 0, 0, 0);
-    video->show();
+    // Only runs while a video is playing in a visible window
+    videoInfoTimer.setInterval(VIDEO_INFO_INTERVAL_MS);
+    connect(&videoInfoTimer, &QTimer::timeout, [this]() { showVideoInfo(); });
 
-    player->setVideoOutput(video.get());
-    player->setVolume(50);
-    player->setPlaylist(playlist.get());
+    tipTimer.setSingleShot(true);
+    connect(&tipTimer, &QTimer::timeout, [this]()
+    {
+        if (!videoMode)
+        {
+            videoInfoLabel->setVisible(false);
+        }
+    });
 
-    playlist->setPlaybackMode(QMediaPlaylist::PlaybackMode::Loop);
+    searchLabel = std::make_unique<QLabel>(this);
+    searchLabel->setFont(videoInfoFont);
+    searchLabel->setVisible(false);
+    searchLabel->setStyleSheet("color: #EEEEEE; background-color: rgba(0, 0, 0, 192); padding: 4px;");
+
+    frameStepLabel = std::make_unique<QLabel>(this);
+    frameStepLabel->setVisible(false);
+    frameStepLabel->setAlignment(Qt::AlignCenter);
+    frameStepLabel->setStyleSheet("background-color: black;");
+
+    seekPreviewLabel = std::make_unique<QLabel>(this);
+    seekPreviewLabel->setVisible(false);
+    seekPreviewLabel->setStyleSheet("border: 1px solid #EEEEEE;");
+
+    transcodeQueue = std::make_unique<TranscodeQueue>([this](size_t done, size_t total)
+    {
+        QMetaObject::invokeMethod(this, [this, done, total]()
+        {
+            if (!videoMode)
+            {
+                showTip(QString("Transcoding animations: %1/%2").arg(done).arg(total));
+            }
+        });
+    });
+
+    navigationTimer.setSingleShot(true);
+    connect(&navigationTimer, &QTimer::timeout, [this]() { applyPendingNavigation(); });
+
+    seekPreviewTimer.setSingleShot(true);
+    connect(&seekPreviewTimer, &QTimer::timeout, [this]() { seekPreviewLabel->setVisible(false); });
+
+    // Multimedia is set up once the first image is on screen (or right away for a video)
+    ui->image_view->installEventFilter(this);
 
     setWindowFlags(windowFlags() | Qt::CustomizeWindowHint |
         Qt::WindowMinimizeButtonHint |
@@ -195,17 +188,212 @@ MainWindow::MainWindow(const fs_str_t& target, QWidget* parent) :
         Qt::WindowCloseButtonHint);
 
     loadItem();
+    startItemListSetup();
+}
+
+void MainWindow::setResident(bool value)
+{
+    resident = value;
+}
 
-    std::thread([&]()
+void MainWindow::openTarget(const fs_str_t& requestedTarget)
+{
+    fs_str_t newTarget = resolveArchiveTarget(requestedTarget);
+
+    setWindowState(windowState() & ~Qt::WindowMinimized);
+    show();
+    raise();
+    activateWindow();
+
+    if (getBrowseDirectory(newTarget) != currentDir)
     {
-        setupItemList();
-        itemListReady = true;
+        target = newTarget;
+        currentDir = getBrowseDirectory(newTarget);
+        resetView();
+        loadItem();
+        startItemListSetup();
+        return;
+    }
 
-        loadSurroundingNext();
+    // Same directory: the item list and the prefetched neighbours are reused
+    if (!itemListReady)
+    {
+        target = newTarget;
+        resetView();
+        loadItem();
+        return;
+    }
+
+    size_t idx = itemList.find(newTarget);
+    if (idx == itemList.size())
+    {
+        // Not there when the directory was scanned
+        target = newTarget;
+        resetView();
+        loadItem();
+        startItemListSetup();
+        return;
+    }
+
+    if (idx == itemListIndex + 1)
+    {
+        nextItem();
+    }
+    else if (idx + 1 == itemListIndex)
+    {
+        previousItem();
+    }
+    else if (idx != itemListIndex)
+    {
+        resetView();
+        itemListIndex = idx;
+        target = newTarget;
+        loadItem();
         loadSurroundingPrev();
+        loadSurroundingNext();
+        scheduleBackgroundWork();
+    }
+}
+
+void MainWindow::startItemListSetup()
+{
+    itemListReady = false;
+    duplicateMode = false;
+    closeSearch();
+    size_t generation = ++itemListGeneration;
+    dropSurroundingFrames();
+
+    // Scanned into a list of its own, swapped in on the UI thread unless another scan started meanwhile
+    std::thread([this, dir = currentDir, order = sortOrder, generation]()
+    {
+        ItemList items;
+        ItemColumns columns;
+        scanMediaItems(dir, items, columns);
+        applyItemOrder(items, columns, getSortedItemOrder(items, columns, order));
+
+        QMetaObject::invokeMethod(this, [this, items = std::move(items), columns = std::move(columns), generation]() mutable
+        {
+            if (generation == itemListGeneration)
+            {
+                setupItemList(std::move(items), std::move(columns));
+            }
+        });
     }).detach();
 }
 
+void MainWindow::closeEvent(QCloseEvent* e)
+{
+    if (resident)
+    {
+        // Keep running in the background with warm caches for the next launch
+        if (player)
+        {
+            player->stop();
+        }
+        hide();
+        e->ignore();
+        return;
+    }
+    QMainWindow::closeEvent(e);
+}
+
+void MainWindow::changeEvent(QEvent* e)
+{
+    QMainWindow::changeEvent(e);
+    if (e->type() == QEvent::WindowStateChange)
+    {
+        updateVideoInfoTimer();
+    }
+}
+
+void MainWindow::showEvent(QShowEvent* e)
+{
+    QMainWindow::showEvent(e);
+    updateVideoInfoTimer();
+}
+
+void MainWindow::hideEvent(QHideEvent* e)
+{
+    QMainWindow::hideEvent(e);
+    updateVideoInfoTimer();
+}
+
+void MainWindow::initMultimedia()
+{
+    if (player)
+    {
+        return;
+    }
+
+    QElapsedTimer initTimer;
+    initTimer.start();
+
+    player = std::make_unique<QMediaPlayer>();
+    playlist = std::make_unique<QMediaPlaylist>(player.get());
+    video = std::make_unique<QVideoWidget>();
+
+    centralWidget()->layout()->addWidget(video.get());
+    video->setContentsMargins(0, 0, 0, 0);
+    video->setVisible(videoMode);
+
+    player->setVideoOutput(video.get());
+    player->setVolume(50);
+    player->setPlaylist(playlist.get());
+
+    playlist->setPlaybackMode(QMediaPlaylist::PlaybackMode::Loop);
+
+    // Paused videos only need the position text refreshed when something changes it
+    connect(player.get(), &QMediaPlayer::stateChanged, this, [this](QMediaPlayer::State state)
+    {
+        if (state == QMediaPlayer::State::PlayingState)
+        {
+            leaveFrameStep();
+        }
+        updateVideoInfoTimer();
+    });
+    connect(player.get(), &QMediaPlayer::positionChanged, this, [this]()
+    {
+        if (videoMode && !videoInfoTimer.isActive())
+        {
+            showVideoInfo();
+        }
+    });
+    connect(player.get(), &QMediaPlayer::playbackRateChanged, this, [this]()
+    {
+        if (videoMode)
+        {
+            showVideoInfo();
+        }
+    });
+
+    if (qEnvironmentVariableIsSet("IGAL_TRACE_STARTUP"))
+    {
+        std::cerr << "Multimedia initialized in " << initTimer.elapsed() << " ms\n";
+    }
+}
+
+bool MainWindow::eventFilter(QObject* obj, QEvent* e)
+{
+    if (obj == ui->image_view && e->type() == QEvent::Paint && !firstImagePainted)
+    {
+        auto pixmap = ui->image_view->pixmap();
+        if (pixmap && !pixmap->isNull())
+        {
+            firstImagePainted = true;
+            ui->image_view->removeEventFilter(this);
+
+            if (qEnvironmentVariableIsSet("IGAL_TRACE_STARTUP"))
+            {
+                std::cerr << "First image painted after " << startupTimer.elapsed() << " ms\n";
+            }
+
+            // Loading the multimedia backend blocks for a while: give the first image time to reach the screen
+            QTimer::singleShot(MULTIMEDIA_WARMUP_DELAY_MS, this, [this]() { initMultimedia(); });
+        }
+    }
+    return QMainWindow::eventFilter(obj, e);
+}
+
 std::string formatVideoPosition(qint64 posMs, qint64 totalMs)
 {
     qint64 posSecondsAbs = posMs / 1000;
@@ -256,6 +444,10 @@ void MainWindow::showVideoInfo()
     {
         posText += " (x" + std::to_string(player->playbackRate()) +")";
     }
+    if (frameStepIndex >= 0)
+    {
+        posText += " frame " + std::to_string(frameStepIndex + 1) + "/" + std::to_string(videoStream.frameCount);
+    }
     videoInfoLabel->setText(QString::fromStdString(posText));
     videoInfoLabel->setGeometry(0, 0, videoInfoFontMetrics->horizontalAdvance(QString::fromStdString(posText)), videoInfoLabel->font().pixelSize());
 }
@@ -265,6 +457,30 @@ void MainWindow::hideVideoInfo()
     videoInfoLabel->setText("");
 }
 
+void MainWindow::updateVideoInfoTimer()
+{
+    bool playing = videoMode && player && player->state() == QMediaPlayer::State::PlayingState;
+    if (playing && isVisible() && !isMinimized())
+    {
+        if (!videoInfoTimer.isActive())
+        {
+            showVideoInfo();
+            videoInfoTimer.start();
+        }
+        return;
+    }
+
+    videoInfoTimer.stop();
+    if (videoMode && player)
+    {
+        showVideoInfo();
+    }
+    else
+    {
+        hideVideoInfo();
+    }
+}
+
 void MainWindow::togglePauseVideo()
 {
     if (!videoMode)
@@ -289,6 +505,7 @@ void MainWindow::loadRandom()
     loadItem();
     loadSurroundingPrev();
     loadSurroundingNext();
+    scheduleBackgroundWork();
 }
 
 void MainWindow::toggleMuteVideo()
@@ -322,6 +539,7 @@ void MainWindow::toggleFullscreen()
 
 void MainWindow::skipPrev(int amount)
 {
+    navigationDirection = -1;
     if (itemListIndex <= amount)
     {
         itemListIndex = 0;
@@ -334,10 +552,12 @@ void MainWindow::skipPrev(int amount)
     loadItem();
     loadSurroundingPrev();
     loadSurroundingNext();
+    scheduleBackgroundWork();
 }
 
 void MainWindow::skipNext(int amount)
 {
+    navigationDirection = 1;
     if (itemListIndex >= itemList.size() - 1 - amount)
     {
         itemListIndex = itemList.size() - 1;
@@ -350,72 +570,420 @@ void MainWindow::skipNext(int amount)
     loadItem();
     loadSurroundingPrev();
     loadSurroundingNext();
+    scheduleBackgroundWork();
 }
 
 void MainWindow::rewindVideo(int milliseconds)
 {
-    player->setPosition(player->position() - milliseconds);
+    if (!videoMode)
+    {
+        return;
+    }
+
+    seekVideo(player->position() - milliseconds);
 }
 
 void MainWindow::fforwardVideo(int milliseconds)
 {
-    player->setPosition(player->position() + milliseconds);
+    if (!videoMode)
+    {
+        return;
+    }
+
+    seekVideo(player->position() + milliseconds);
+}
+
+void MainWindow::seekVideo(qint64 positionMs)
+{
+    leaveFrameStep();
+
+    qint64 currentMs = player->position();
+    positionMs = std::clamp<qint64>(positionMs, 0, std::max<qint64>(player->duration(), 0));
+
+    if (videoPreview && videoPreview->isValid())
+    {
+        // Landing on a keyframe spares the backend a decode from the previous one,
+        // as long as snapping doesn't turn the seek around
+        qint64 snapped = videoPreview->snapToKeyframe(positionMs, KEYFRAME_SNAP_TOLERANCE_MS);
+        if ((snapped - currentMs > 0) == (positionMs - currentMs > 0) && snapped != currentMs)
+        {
+            positionMs = snapped;
+        }
+        showSeekPreview(positionMs);
+    }
+
+    player->setPosition(positionMs);
+}
+
+void MainWindow::showSeekPreview(qint64 positionMs)
+{
+    QImage frame = videoPreview->getFrame(positionMs);
+    if (frame.isNull())
+    {
+        return;
+    }
+
+    QPixmap pxmap = QPixmap::fromImage(frame.scaled(frame.size() * SEEK_PREVIEW_SCALE, Qt::KeepAspectRatio, Qt::SmoothTransformation));
+    seekPreviewLabel->setPixmap(pxmap);
+    seekPreviewLabel->setGeometry(
+        (width() - pxmap.width()) / 2,
+        height() - pxmap.height() - SEEK_PREVIEW_MARGIN,
+        pxmap.width(),
+        pxmap.height());
+    seekPreviewLabel->raise();
+    seekPreviewLabel->setVisible(true);
+
+    seekPreviewTimer.start(SEEK_PREVIEW_HIDE_MS);
 }
 
 void MainWindow::increaseVideoSpeed(float v)
 {
+    if (!videoMode)
+    {
+        return;
+    }
+
     player->setPlaybackRate(player->playbackRate() + v);
 }
 
 void MainWindow::decreaseVideoSpeed(float v)
 {
+    if (!videoMode)
+    {
+        return;
+    }
+
     player->setPlaybackRate(player->playbackRate() - v);
 }
 
 void MainWindow::resetVideoSpeed()
 {
+    if (!videoMode)
+    {
+        return;
+    }
+
     player->setPlaybackRate(1);
 }
 
-void MainWindow::addZoom(float amount)
+void MainWindow::stepVideoFrame(int direction)
 {
-    if (!videoMode)
+    if (!videoMode || !player)
     {
-        zoom += amount;
-        if (zoom < 1.0F)
+        return;
+    }
+
+    if (!videoStream.isValid())
+    {
+        showTip("Frame stepping is not ready yet");
+        return;
+    }
+
+    if (frameStepIndex < 0)
+    {
+        player->pause();
+
+        // Frames are decoded at the size they are shown at
+        QSize frameSize = videoStream.size.scaled(getViewportSize(), Qt::KeepAspectRatio).boundedTo(videoStream.size);
+        if (frameSize != frameRingSize)
         {
-            zoom = 1;
+            size_t frameBytes = static_cast<size_t>(frameSize.width()) * frameSize.height() * 4;
+            frameRing.reset(std::clamp(FRAME_RING_BYTES / std::max<size_t>(frameBytes, 1), FRAME_RING_MIN_FRAMES, FRAME_RING_MAX_FRAMES));
+            frameRingSize = frameSize;
+            ++frameStepGeneration;
+            frameStepDecoding = false;
         }
-        reloadCurrentImage();
+        frameStepIndex = videoStream.getFrameAt(player->position());
     }
+
+    frameStepIndex = std::clamp<qint64>(frameStepIndex + direction, 0, videoStream.frameCount - 1);
+    frameStepDirection = direction;
+    showSteppedFrame();
+    requestStepFrames();
 }
 
-void MainWindow::addOffset(float x, float y)
+void MainWindow::showSteppedFrame()
 {
-    if (!videoMode)
+    frameStepLabel->setGeometry(0, 0, width(), height());
+    if (frameRing.contains(frameStepIndex))
     {
-        currentX += x;
-        currentY += y;
-        reloadCurrentImage();
+        QPixmap pixmap = QPixmap::fromImage(frameRing.get(frameStepIndex));
+        pixmap.setDevicePixelRatio(devicePixelRatioF());
+        frameStepLabel->setPixmap(pixmap);
+        frameStepLabel->raise();
+        frameStepLabel->setVisible(true);
+        videoInfoLabel->raise();
     }
-}
 
-void MainWindow::resetZoomAndOffset()
-{
-    zoom = 1;
-    currentX = 0;
-    currentY = 0;
-    if (!videoMode)
-    {
-        reloadCurrentImage();
-    };
+    // Playback resumes from the stepped frame
+    player->setPosition(videoStream.getFramePositionMs(frameStepIndex));
+    showVideoInfo();
 }
 
-void MainWindow::hideVideo()
+// Frames per ffmpeg run: the whole GOP around the run, since it gets decoded anyway
+qint64 MainWindow::getFrameStepBatch() const
+{
+    qint64 batch = FRAME_STEP_MIN_BATCH;
+    if (videoPreview && !videoPreview->keyframesMs.empty())
+    {
+        const auto& keyframes = videoPreview->keyframesMs;
+        if (frameStepDirection > 0)
+        {
+            qint64 from = frameRing.contains(frameStepIndex) ? frameRing.getEnd() : frameStepIndex;
+            auto next = std::upper_bound(keyframes.begin(), keyframes.end(), videoStream.getFramePositionMs(from));
+            if (next != keyframes.end())
+            {
+                batch = std::max(batch, videoStream.getFrameAt(*next) - from);
+            }
+        }
+        else
+        {
+            qint64 until = frameRing.contains(frameStepIndex) ? frameRing.getFirst() : frameStepIndex + 1;
+            auto next = std::upper_bound(keyframes.begin(), keyframes.end(), videoStream.getFramePositionMs(until - 1));
+            if (next != keyframes.begin())
+            {
+                batch = std::max(batch, until - videoStream.getFrameAt(*(next - 1)));
+            }
+        }
+    }
+    return std::min<qint64>(batch, static_cast<qint64>(frameRing.getCapacity() / 2));
+}
+
+void MainWindow::requestStepFrames()
+{
+    if (frameStepDecoding || frameStepIndex < 0)
+    {
+        return;
+    }
+
+    // The frame to show first, then ahead of the playhead in the stepping direction
+    qint64 batch = getFrameStepBatch();
+    qint64 start;
+    if (!frameRing.contains(frameStepIndex))
+    {
+        start = frameStepDirection > 0 ? frameStepIndex : frameStepIndex - batch + 1;
+    }
+    else if (frameStepDirection > 0 && frameRing.getEnd() - frameStepIndex <= FRAME_STEP_PREFETCH_MARGIN && frameRing.getEnd() < videoStream.frameCount)
+    {
+        start = frameRing.getEnd();
+    }
+    else if (frameStepDirection < 0 && frameStepIndex - frameRing.getFirst() < FRAME_STEP_PREFETCH_MARGIN && frameRing.getFirst() > 0)
+    {
+        start = frameRing.getFirst() - batch;
+    }
+    else
+    {
+        return;
+    }
+
+    start = std::max<qint64>(start, 0);
+    int count = static_cast<int>(std::min(batch, videoStream.frameCount - start));
+
+    frameStepDecoding = true;
+    std::thread([this, path = videoPreviewPath, info = videoStream, start, count, size = frameRingSize, generation = frameStepGeneration]()
+    {
+        auto frames = decodeVideoFrames(path, info, start, count, size);
+        QMetaObject::invokeMethod(this, [this, frames = std::move(frames), start, generation]() mutable
+        {
+            if (generation != frameStepGeneration)
+            {
+                return;
+            }
+            frameStepDecoding = false;
+
+            bool decoded = !frames.empty();
+            bool wasShown = frameRing.contains(frameStepIndex);
+            frameRing.insert(start, std::move(frames));
+            if (frameStepIndex < 0 || !decoded || !frameRing.contains(frameStepIndex))
+            {
+                return;
+            }
+
+            if (!wasShown)
+            {
+                showSteppedFrame();
+            }
+            requestStepFrames();
+        });
+    }).detach();
+}
+
+void MainWindow::leaveFrameStep()
+{
+    if (frameStepIndex < 0)
+    {
+        return;
+    }
+
+    frameStepIndex = -1;
+    frameStepLabel->setVisible(false);
+    frameStepLabel->clear();
+}
+
+void MainWindow::addZoom(float amount)
+{
+    if (!videoMode)
+    {
+        zoom += amount;
+        if (zoom < 1.0F)
+        {
+            zoom = 1;
+        }
+        // Full resolution for zooming in, swapped in once decoded
+        if (zoom > 1.0F && currentFrame && currentFrame->reduced && fullDecodeGeneration != imageDecodeGeneration)
+        {
+            fullDecodeGeneration = decodeImage(target, QSize(), false);
+        }
+        reloadCurrentImage();
+    }
+}
+
+void MainWindow::addOffset(float x, float y)
+{
+    if (!videoMode)
+    {
+        currentX += x;
+        currentY += y;
+        reloadCurrentImage();
+    }
+}
+
+void MainWindow::resetZoomAndOffset()
+{
+    resetView();
+    if (!videoMode)
+    {
+        reloadCurrentImage();
+    };
+}
+
+// Without repainting: for navigation, where a new frame is shown right after
+void MainWindow::resetView()
+{
+    zoom = 1;
+    currentX = 0;
+    currentY = 0;
+    viewOrientation = Orientation();
+}
+
+QSize MainWindow::getViewportSize() const
+{
+    return size() * devicePixelRatioF();
+}
+
+Orientation MainWindow::getDisplayOrientation() const
+{
+    return combineOrientations(currentFrame ? currentFrame->orientation : Orientation(), viewOrientation);
+}
+
+void MainWindow::setViewOrientation(const Orientation& orientation)
+{
+    if (videoMode || !currentFrame)
+    {
+        return;
+    }
+
+    viewOrientation = orientation;
+    currentX = 0;
+    currentY = 0;
+    reloadCurrentImage();
+}
+
+void MainWindow::saveOrientation()
+{
+    if (videoMode || !currentFrame || viewOrientation.isIdentity())
+    {
+        return;
+    }
+
+    if (getTargetExtension(target) != FSSTR(".jpg") && getTargetExtension(target) != FSSTR(".jpeg"))
+    {
+        showTip("Rotations can only be saved to JPEG files");
+        return;
+    }
+
+    // Only the EXIF tag changes: the compressed image data is left as is
+    Orientation orientation = getDisplayOrientation();
+    std::thread([this, path = target, orientation]()
+    {
+        bool ok = writeJpegOrientation(path, toExifOrientation(orientation));
+        QMetaObject::invokeMethod(this, [this, path, orientation, ok]()
+        {
+            if (!ok)
+            {
+                showTip("Could not save the rotation");
+                return;
+            }
+
+            // Same pixels, now oriented by the file itself
+            if (path == target && currentFrame)
+            {
+                auto frame = std::make_shared<Frame>(*currentFrame);
+                frame->orientation = orientation;
+                frame->display = QImage();
+                frame->displayViewport = QSize();
+                currentFrame = std::move(frame);
+                viewOrientation = Orientation();
+            }
+            showTip("Rotation saved");
+        });
+    }).detach();
+}
+
+void MainWindow::exportContactSheet()
+{
+    if (!itemListReady || itemList.empty())
+    {
+        return;
+    }
+
+    std::error_code ec;
+    QString startDir = std::filesystem::is_directory(currentDir, ec) ? fsstrToQstring(currentDir) : QDir::homePath();
+    QString path = QFileDialog::getSaveFileName(this, "Export contact sheet", QDir(startDir).filePath("contact-sheet.jpg"), "Images (*.jpg *.jpeg *.png)");
+    if (path.isEmpty())
+    {
+        return;
+    }
+
+    fs_str_t outputPath = qstringToFsstr(path);
+    fs_str_t ext = getTargetExtension(outputPath);
+    if (ext != FSSTR(".jpg") && ext != FSSTR(".jpeg") && ext != FSSTR(".png"))
+    {
+        outputPath += FSSTR(".jpg");
+    }
+
+    // Exports the list as shown: sorted, or narrowed down to duplicates
+    showTip("Exporting contact sheet...");
+    std::thread([this, items = itemList, outputPath]()
+    {
+        ContactSheetLayout layout;
+        size_t pageCount = getContactSheetCount(items.size(), layout);
+        size_t written = exportContactSheets(items, outputPath, layout, [this](size_t done, size_t total)
+        {
+            QMetaObject::invokeMethod(this, [this, done, total]()
+            {
+                showTip(QString("Contact sheet: %1/%2").arg(done).arg(total));
+            });
+        });
+
+        QMetaObject::invokeMethod(this, [this, written, pageCount]()
+        {
+            showTip(written == pageCount ? QString("Contact sheet saved: %1 pages").arg(pageCount) : QString("Could not save the contact sheet"));
+        });
+    }).detach();
+}
+
+void MainWindow::hideVideo()
 {
     videoMode = false;
-    video->setVisible(false);
+    if (video)
+    {
+        video->setVisible(false);
+    }
     videoInfoLabel->setVisible(false);
+    seekPreviewLabel->setVisible(false);
+    leaveFrameStep();
+    updateVideoInfoTimer();
 }
 
 void MainWindow::showVideo()
@@ -467,20 +1035,17 @@ void MainWindow::loadLinks()
     }
 }
 
-void MainWindow::copyToDir(const fs_str_t& dir)
+void MainWindow::showTip(const QString& text)
 {
-    auto showTip = [&]() {
-        videoInfoLabel->setVisible(true);
-        videoInfoLabel->setText("Copied to " + fsstrToQstring(dir));
+    videoInfoLabel->setVisible(true);
+    videoInfoLabel->setText(text);
+    videoInfoLabel->setGeometry(0, 0, videoInfoFontMetrics->horizontalAdvance(text), videoInfoLabel->font().pixelSize());
 
-        std::thread([&]() {
-            std::this_thread::sleep_for(std::chrono::milliseconds(750));
-            if (!videoMode)
-            {
-                QMetaObject::invokeMethod(this, [&]() { videoInfoLabel->setVisible(false); });
-            }
-        }).detach();
-    };
+    tipTimer.start(TIP_DURATION_MS);
+}
+
+void MainWindow::copyToDir(const fs_str_t& dir)
+{
 
     auto fulldir = currentDir + dir;
     auto dirUp1 = currentDir + FSSTR("..") + DIR_SEPARATOR + dir;
@@ -488,13 +1053,13 @@ void MainWindow::copyToDir(const fs_str_t& dir)
     {        
         auto dest = fulldir + DIR_SEPARATOR + getTargetFilename(target);
         bool copy_ok = std::filesystem::copy_file(target, dest, std::filesystem::copy_options::skip_existing);
-        showTip();
+        showTip("Copied to " + fsstrToQstring(dir));
     }
     else if (std::filesystem::exists(dirUp1) && std::filesystem::exists(target))
     {
         auto dest = dirUp1 + DIR_SEPARATOR + getTargetFilename(target);
         bool copy_ok = std::filesystem::copy_file(target, dest, std::filesystem::copy_options::skip_existing);
-        showTip();
+        showTip("Copied to " + fsstrToQstring(dir));
     }    
 }
 
@@ -513,6 +1078,12 @@ void MainWindow::keyPressEvent(QKeyEvent* e)
 {
     QMainWindow::keyPressEvent(e);
 
+    if (searchMode)
+    {
+        handleSearchKey(e);
+        return;
+    }
+
     bool altPressed = e->modifiers().testFlag(Qt::KeyboardModifier::AltModifier);
     bool shiftPressed = e->modifiers().testFlag(Qt::KeyboardModifier::ShiftModifier);
     bool ctrlPressed = e->modifiers().testFlag(Qt::KeyboardModifier::ControlModifier);
@@ -527,7 +1098,14 @@ void MainWindow::keyPressEvent(QKeyEvent* e)
     {
     case 'f':
     case 'F':
-        toggleFullscreen();
+        if (ctrlPressed)
+        {
+            openSearch();
+        }
+        else
+        {
+            toggleFullscreen();
+        }
         break;
 
     case 'm':
@@ -545,12 +1123,86 @@ void MainWindow::keyPressEvent(QKeyEvent* e)
         togglePauseVideo();
         break;
 
+    case 'q':
+    case 'Q':
+        if (ctrlPressed && !shiftPressed)
+        {
+            QApplication::quit();
+        }
+        break;
+
+    case 's':
+    case 'S':
+        if (!ctrlPressed)
+        {
+            cycleSortOrder();
+        }
+        else if (!shiftPressed)
+        {
+            saveOrientation();
+        }
+        break;
+
+    case 'd':
+    case 'D':
+        if (!ctrlPressed)
+        {
+            toggleDuplicateMode();
+        }
+        break;
+
+    case 'e':
+    case 'E':
+        if (!ctrlPressed)
+        {
+            exportContactSheet();
+        }
+        break;
+
+    case 'h':
+    case 'H':
+        if (!ctrlPressed)
+        {
+            setViewOrientation(flipHorizontally(viewOrientation));
+        }
+        break;
+
+    case 'v':
+    case 'V':
+        if (!ctrlPressed)
+        {
+            setViewOrientation(flipVertically(viewOrientation));
+        }
+        break;
+
+    case Qt::Key_BracketLeft:
+        setViewOrientation(rotateCounterClockwise(viewOrientation));
+        break;
+
+    case Qt::Key_BracketRight:
+        setViewOrientation(rotateClockwise(viewOrientation));
+        break;
+
     case Qt::Key_PageUp:
-        skipPrev(10);
+        if (duplicateMode)
+        {
+            skipDuplicateGroup(-1);
+        }
+        else
+        {
+            skipPrev(10);
+        }
         break;
 
     case Qt::Key_PageDown:
-        skipNext(10);
+        if (duplicateMode)
+        {
+            skipDuplicateGroup(1);
+        }
+        else
+        {
+            skipNext(10);
+        }
         break;
 
     case Qt::Key_Escape:
@@ -569,6 +1221,10 @@ void MainWindow::keyPressEvent(QKeyEvent* e)
         {
             decreaseVideoSpeed(0.05F);
         }
+        else if (e->isAutoRepeat())
+        {
+            queueNavigation(-1);
+        }
         else
         {
             previousItem();
@@ -584,6 +1240,10 @@ void MainWindow::keyPressEvent(QKeyEvent* e)
         {
             increaseVideoSpeed(0.05F);
         }
+        else if (e->isAutoRepeat())
+        {
+            queueNavigation(1);
+        }
         else
         {
             nextItem();
@@ -591,6 +1251,14 @@ void MainWindow::keyPressEvent(QKeyEvent* e)
 
         break;
 
+    case Qt::Key_Comma:
+        stepVideoFrame(-1);
+        break;
+
+    case Qt::Key_Period:
+        stepVideoFrame(1);
+        break;
+
     case Qt::Key_Home:
         loadFirstItem();
         break;
@@ -639,32 +1307,46 @@ void MainWindow::keyPressEvent(QKeyEvent* e)
     }
 }
 
+void MainWindow::keyReleaseEvent(QKeyEvent* e)
+{
+    QMainWindow::keyReleaseEvent(e);
+
+    // Auto-repeat sends release events too, only the real one ends the scroll
+    if (!e->isAutoRepeat() && (e->key() == Qt::Key_Left || e->key() == Qt::Key_Right))
+    {
+        finishFastNavigation();
+    }
+}
+
 template<typename T>
 T getSign(T val)
 {
     return val < 0 ? -1 : 1;
 }
 
-QPixmap MainWindow::getTransformedPixmap(const QPixmap* px)
+QPixmap MainWindow::getTransformedPixmap(const Frame& frame)
 {
-    // TODO: fix zoom-out overflowing
-    if (!ui->image_view->pixmap() || ui->image_view->pixmap()->isNull())
-    {
-        return px->scaled(size(), Qt::KeepAspectRatio, Qt::SmoothTransformation);
-    }
+    // Sizes are in device pixels, so the image stays sharp on high-DPI screens
+    QSize viewport = getViewportSize();
 
-    float pxmapW = ui->image_view->pixmap()->width();
-    float pxmapH = ui->image_view->pixmap()->height();
+    // Prefetched frames come already scaled for the window, unless zoomed or turned by the user
+    bool prepared = zoom == 1.0F
+        && viewOrientation.isIdentity()
+        && !frame.display.isNull()
+        && frame.displayViewport == viewport;
+
+    // TODO: fix zoom-out overflowing
+    QImage scaled = prepared ? frame.display : scaleFrameForDisplay(frame, viewport * zoom, viewOrientation);
 
-    float maxRadiusX = std::abs((pxmapW - width()) / 2);
-    float maxRadiusY = std::abs((pxmapH - height()) / 2);
+    float maxRadiusX = std::abs((scaled.width() - viewport.width()) / 2.0F);
+    float maxRadiusY = std::abs((scaled.height() - viewport.height()) / 2.0F);
 
-    if (pxmapW <= width())
+    if (scaled.width() <= viewport.width())
     {
         currentX = 0;
     }
 
-    if (pxmapH <= height())
+    if (scaled.height() <= viewport.height())
     {
         currentY = 0;
     }
@@ -679,18 +1361,32 @@ QPixmap MainWindow::getTransformedPixmap(const QPixmap* px)
         currentY = maxRadiusY * getSign(currentY);
     }
 
-    QPixmap result = *px;
-    result.scroll(currentX, currentY, result.rect());
-    return result.scaled(size() * zoom, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+    // The pixmap adopts a freshly scaled buffer instead of copying it. Prepared ones
+    // are shared with the frame: pixmaps can't be made off the UI thread, so
+    // they still take a plain copy, but no scaling or format conversion.
+    QPixmap result = QPixmap::fromImage(std::move(scaled));
+    if (currentX != 0 || currentY != 0)
+    {
+        result.scroll(currentX, currentY, result.rect());
+    }
+    result.setDevicePixelRatio(devicePixelRatioF());
+    return result;
 }
 
 void MainWindow::resizeEvent(QResizeEvent* e)
 {
     if (!videoMode && !ui->image_view->pixmap()->isNull())
     {
-        ui->image_view->setPixmap(getTransformedPixmap(ui->image_view->pixmap()));
+        // Cheap stand-in while resizing, resizeEnd() rescales the frame properly
+        QPixmap stretched = ui->image_view->pixmap()->scaled(getViewportSize() * zoom, Qt::KeepAspectRatio, Qt::FastTransformation);
+        stretched.setDevicePixelRatio(devicePixelRatioF());
+        ui->image_view->setPixmap(stretched);
         resizeTimer.start(200);
     }
+    else if (videoMode && frameStepIndex >= 0)
+    {
+        frameStepLabel->setGeometry(0, 0, width(), height());
+    }
     QWidget::resizeEvent(e);
 }
 
@@ -698,171 +1394,207 @@ void MainWindow::resizeEnd()
 {
     if (!videoMode)
     {
+        // The window outgrew a reduced-size decode
+        QSize viewport = getViewportSize();
+        QSize shownSize = currentFrame ? currentFrame->image.size() : QSize();
+        if (getDisplayOrientation().isTransposed())
+        {
+            shownSize.transpose();
+        }
+
+        if (currentFrame
+            && currentFrame->reduced
+            && shownSize.width() < viewport.width() * zoom
+            && shownSize.height() < viewport.height() * zoom)
+        {
+            decodeImage(target, viewport * zoom, false);
+        }
         reloadCurrentImage();
+        rescaleSurroundingFrames();
     }
 }
 
-void initCacheDir(const fs_str_t& target)
+void MainWindow::playVideo(const fs_str_t& vpath)
 {
-    auto tpath = getTargetDirectory(target) + CACHE_DIR;
+    initMultimedia();
 
-    if(!std::filesystem::exists(tpath))
-    {
-        std::filesystem::create_directory(tpath);
-    }
-}
+    // An image decode still running must not replace the video
+    ++imageDecodeGeneration;
 
-bool isAnimatedPng(const fs_str_t& target)
-{
-    std::ifstream ifs(target, std::ios::binary);
-    ifs >> std::noskipws;
+    hideImage();
+    showVideo();
 
-    std::string data(4096, 0);
-    ifs.read(data.data(), data.size());
+    ui->image_view->setPixmap(QPixmap());
 
-    return data.find("acTL") != std::string::npos;
-}
+    auto media = QUrl::fromLocalFile(fsstrToQstring(vpath.c_str()));
 
-fs_str_t genFfmpegCmd(const fs_str_t& source, const fs_str_t& target)
-{
-    return FSSTR("ffmpeg -y -i \"") + source + FSSTR("\" -pix_fmt yuv420p \"") + target + FSSTR("\"");
-}
+    playlist->clear();
+    playlist->addMedia(media);
+    playlist->setCurrentIndex(0);
 
-fs_str_t getCachedAnimatedPath(const fs_str_t& target)
-{
-    auto cached_path = getTargetDirectory(target) + CACHE_DIR + DIR_SEPARATOR + getTargetFilename(target) + OS_VID_FMT;
+    player->setPlaybackRate(1);
 
-    if (!std::filesystem::exists(cached_path))
+    if (!playlist->isEmpty())
     {
-        initCacheDir(target);
+        player->play();
+    }
 
-        fs_str_t ffmpeg_cmd_mp4 = genFfmpegCmd(target, cached_path);
-        fs_system(ffmpeg_cmd_mp4.c_str());
+    // Decoded frames belong to the previous video
+    leaveFrameStep();
+    frameRing.reset(0);
+    frameRingSize = QSize();
+    videoStream = VideoStreamInfo();
+    ++frameStepGeneration;
+    frameStepDecoding = false;
+
+    // Seek previews and the keyframe index are built once per video, in the background
+    videoPreview.reset();
+    videoPreviewPath = vpath;
+    std::thread([&, vpath]()
+    {
+        auto stream = probeVideoStream(vpath);
+        QMetaObject::invokeMethod(this, [&, vpath, stream]()
+        {
+            if (videoPreviewPath == vpath)
+            {
+                videoStream = stream;
+            }
+        });
 
-        bool ok = std::filesystem::exists(target);
-        if (!ok)
+        auto preview = loadVideoPreview(vpath);
+        QMetaObject::invokeMethod(this, [&, vpath, preview]()
         {
-            return fs_str_t();
-        }
-    }
+            if (videoPreviewPath == vpath)
+            {
+                videoPreview = preview;
+            }
+        });
+    }).detach();
 
-    return cached_path;
+    updateVideoInfoTimer();
 }
 
-void MainWindow::playVideo(const fs_str_t& vpath)
+void MainWindow::playImage(const fs_str_t& ipath)
 {
-    hideImage();
-    showVideo();
-
-    ui->image_view->setPixmap(QPixmap());
-
-    auto media = QUrl::fromLocalFile(fsstrToQstring(vpath.c_str()));
+    // The shown pixmap stays up until the decode is done, but it no longer belongs to 'target'
+    currentFrame = nullptr;
 
-    playlist->clear();
-    playlist->addMedia(media);
-    playlist->setCurrentIndex(0);
-
-    player->setPlaybackRate(1);
-
-    if (!playlist->isEmpty())
+    // The scan has the size already. Only an item opened before its directory was
+    // scanned is looked up, right after opening it brought its attributes in.
+    uintmax_t fileSize = 0;
+    if (itemListReady && itemListIndex < itemList.size() && itemList.getPath(itemListIndex) == ipath)
     {
-        player->play();
+        fileSize = itemColumns.size[itemListIndex];
     }
-
-    std::thread([&]()
+    else
     {
-        while (videoMode)
-        {
-            QMetaObject::invokeMethod(this, [&] { showVideoInfo(); });
-            std::this_thread::sleep_for(std::chrono::milliseconds(100));
-        }
-        QMetaObject::invokeMethod(this, [&] { hideVideoInfo(); });
-    }).detach();
+        std::error_code ec;
+        fileSize = std::filesystem::file_size(ipath, ec);
+        fileSize = ec ? 0 : fileSize;
+    }
+    decodeImage(ipath, getViewportSize() * zoom, isWorthEmbeddedPreview(ipath, fileSize));
 }
 
-void MainWindow::playImage(const fs_str_t& ipath)
+size_t MainWindow::decodeImage(const fs_str_t& path, const QSize& targetSize, bool withPreview)
 {
-    hideVideo();
-    showImage();
+    size_t generation = ++imageDecodeGeneration;
+    QSize viewport = zoom == 1.0F ? getViewportSize() : QSize();
 
-    player->stop();
-    playlist->clear();
+    // Decoded and converted for the window off the UI thread. The camera's preview, if
+    // worth it, is shown first. Both are dropped once another image is shown.
+    std::thread([this, path, targetSize, withPreview, viewport, generation]()
+    {
+        auto show = [this, generation](FramePtr frame)
+        {
+            QMetaObject::invokeMethod(this, [this, frame = std::move(frame), generation]()
+            {
+                if (generation == imageDecodeGeneration)
+                {
+                    playImage(frame);
+                }
+            });
+        };
+
+        FramePtr preview = withPreview ? decodePreviewFrame(path, targetSize, EMBEDDED_PREVIEW_MAX_BYTES) : nullptr;
+        if (preview)
+        {
+            show(viewport.isEmpty() ? preview : prepareDisplayFrame(preview, viewport));
+        }
 
-    currentImage = QImage(fsstrToQstring(ipath));
+        // A failed decode leaves the preview up
+        FramePtr frame = decodeFrame(path, targetSize);
+        if (frame || !preview)
+        {
+            show(viewport.isEmpty() ? frame : prepareDisplayFrame(frame, viewport));
+        }
+    }).detach();
 
-    QPixmap pxmap = QPixmap::fromImage(*currentImage);
-    ui->image_view->setPixmap(getTransformedPixmap(&pxmap));
+    return generation;
+}
 
-    return;
+void MainWindow::prepareCurrentFrame()
+{
+    std::thread([this, frame = currentFrame, viewport = getViewportSize(), generation = imageDecodeGeneration.load()]()
+    {
+        FramePtr prepared = prepareDisplayFrame(frame, viewport);
+        QMetaObject::invokeMethod(this, [this, frame, prepared = std::move(prepared), generation]()
+        {
+            if (generation == imageDecodeGeneration && currentFrame == frame)
+            {
+                playImage(prepared);
+            }
+        });
+    }).detach();
 }
 
-void MainWindow::playImage(QImage* image)
+void MainWindow::playImage(FramePtr frame)
 {
     hideVideo();
     showImage();
 
-    player->stop();
-    playlist->clear();
-
-    currentImage = *image;
-
-    QPixmap pxmap = QPixmap::fromImage(*currentImage);
-    ui->image_view->setPixmap(getTransformedPixmap(&pxmap));
-}
-
-bool isImage(const fs_str_t& target)
-{
-    fs_str_t ext = getTargetExtension(target);
-    if (imageExtensions.count(ext))
+    if (player)
     {
-        if (ext != FSSTR(".png"))
-        {
-            return true;
-        }
-        else
-        {
-            return !isAnimatedPng(target);
-        }
+        player->stop();
+        playlist->clear();
     }
-    return false;
-}
 
-bool isAnimation(const fs_str_t& target)
-{
-    fs_str_t ext = getTargetExtension(target);
-    if (animationExtensions.count(ext))
+    currentFrame = std::move(frame);
+    if (currentFrame && zoom == 1.0F && viewOrientation.isIdentity() && currentFrame->displayViewport != getViewportSize())
     {
-        if (ext != FSSTR(".png"))
-        {
-            return true;
-        }
-        else
-        {
-            return isAnimatedPng(target);
-        }
+        // Prepared in the background and kept with the frame, so that coming back to it is a swap
+        // as well. The shown pixmap stays up meanwhile.
+        prepareCurrentFrame();
+        return;
     }
-    return false;
-}
-
-bool isVideo(const fs_str_t& target)
-{
-    return videoExtensions.count(getTargetExtension(target));
+    ui->image_view->setPixmap(currentFrame ? getTransformedPixmap(*currentFrame) : QPixmap());
 }
 
-void MainWindow::loadImage(QImage* pixmap)
+void MainWindow::loadImage(FramePtr frame)
 {
-    playImage(pixmap);
+    ++imageDecodeGeneration;
+    playImage(std::move(frame));
 }
 
 void MainWindow::loadItem()
 {
-    setWindowTitle(fsstrToQstring(getTargetFilename(target)));
+    updateWindowTitle();
 
     std::string ext = std::filesystem::path(target).extension().string();
 
     if (isAnimation(target))
     {
-        playVideo(getCachedAnimatedPath(target));
+        // The transcode may still have to run: the previous item stays up meanwhile
+        std::thread([this, path = target, generation = ++imageDecodeGeneration]()
+        {
+            auto videoPath = getCachedAnimatedPath(path);
+            QMetaObject::invokeMethod(this, [this, videoPath, generation]()
+            {
+                if (generation == imageDecodeGeneration)
+                {
+                    playVideo(videoPath);
+                }
+            });
+        }).detach();
     }
     else if (isImage(target))
     {
@@ -880,69 +1612,156 @@ void MainWindow::loadItem()
 
 void MainWindow::loadSurroundingPrev()
 {
+    // Whatever the slot holds, or is still being decoded for it, belongs to the old position
+    size_t request = ++surroundingPrevRequest;
+    surroundingPrevReady = false;
+
     if (itemListIndex != 0)
     {
-        std::thread([&, idx = itemListIndex]()
+        // The path is read here: the item list may be reordered while the decode runs
+        std::thread([this, prevTarget = itemList[itemListIndex - 1], decodeSize = getViewportSize(), request]()
         {
             std::lock_guard lock(surroundingPrevMux);
-            surroundingPrevReady = false;
-            const auto& prevTarget = itemList[idx - 1];
-            prevName = prevTarget;
-
-            if (isImage(prevTarget))
+            if (request != surroundingPrevRequest || !isImage(prevTarget))
             {
-                surroundingPrev = QImage(fsstrToQstring(prevTarget));
-                surroundingPrevReady = true;
+                return;
             }
+
+            FramePtr frame = prepareDisplayFrame(decodeFrame(prevTarget, decodeSize), decodeSize);
+            QMetaObject::invokeMethod(this, [this, prevTarget, frame = std::move(frame), request]()
+            {
+                if (request == surroundingPrevRequest && frame)
+                {
+                    surroundingPrev = frame;
+                    prevName = prevTarget;
+                    surroundingPrevReady = true;
+                }
+            });
         }).detach();
     }
 }
 
 void MainWindow::loadSurroundingNext()
 {
-    if (itemListIndex < itemList.size() - 1)
+    size_t request = ++surroundingNextRequest;
+    surroundingNextReady = false;
+
+    if (itemListIndex + 1 < itemList.size())
     {
-        std::thread([&, idx = itemListIndex]()
+        std::thread([this, nextTarget = itemList[itemListIndex + 1], decodeSize = getViewportSize(), request]()
         {
             std::lock_guard lock(surroundingNextMux);
-            surroundingNextReady = false;
-            const auto& nextTarget = itemList[idx + 1];
-            nextName = nextTarget;
-
-            if (isImage(nextTarget))
+            if (request != surroundingNextRequest || !isImage(nextTarget))
             {
-                surroundingNext = QImage(fsstrToQstring(nextTarget));
-                surroundingNextReady = true;
+                return;
             }
+
+            FramePtr frame = prepareDisplayFrame(decodeFrame(nextTarget, decodeSize), decodeSize);
+            QMetaObject::invokeMethod(this, [this, nextTarget, frame = std::move(frame), request]()
+            {
+                if (request == surroundingNextRequest && frame)
+                {
+                    surroundingNext = frame;
+                    nextName = nextTarget;
+                    surroundingNextReady = true;
+                }
+            });
         }).detach();
     }
 }
 
+void MainWindow::dropSurroundingFrames()
+{
+    ++surroundingPrevRequest;
+    ++surroundingNextRequest;
+    surroundingPrevReady = false;
+    surroundingNextReady = false;
+}
+
+void MainWindow::rescaleSurroundingFrames()
+{
+    // The decodes are kept, only the display-sized copies are redone for the new size
+    auto rescale = [this](FramePtr frame, bool next, QSize viewport)
+    {
+        std::thread([this, frame, next, viewport]()
+        {
+            FramePtr prepared = prepareDisplayFrame(frame, viewport);
+            QMetaObject::invokeMethod(this, [this, frame, prepared = std::move(prepared), next]()
+            {
+                // Unless navigation or a new prefetch replaced the frame meanwhile
+                if (next && surroundingNextReady && surroundingNext == frame)
+                {
+                    surroundingNext = prepared;
+                }
+                else if (!next && surroundingPrevReady && surroundingPrev == frame)
+                {
+                    surroundingPrev = prepared;
+                }
+            });
+        }).detach();
+    };
+
+    QSize viewport = getViewportSize();
+    if (surroundingNextReady && surroundingNext && surroundingNext->displayViewport != viewport)
+    {
+        rescale(surroundingNext, true, viewport);
+    }
+    if (surroundingPrevReady && surroundingPrev && surroundingPrev->displayViewport != viewport)
+    {
+        rescale(surroundingPrev, false, viewport);
+    }
+}
+
+void MainWindow::scheduleBackgroundWork()
+{
+    transcodeQueue->setFocus(itemListIndex, navigationDirection);
+
+    // The items right next to the current one are read by the decode prefetch itself
+    std::vector<fs_str_t> paths;
+    for (size_t i = 2; i < READAHEAD_MAX_ITEMS + 2; ++i)
+    {
+        long long idx = static_cast<long long>(itemListIndex) + navigationDirection * static_cast<long long>(i);
+        if (idx < 0 || idx >= static_cast<long long>(itemList.size()))
+        {
+            break;
+        }
+        paths.push_back(itemList[idx]);
+    }
+    readahead.schedule(std::move(paths));
+}
+
 void MainWindow::previousItem()
 {
-    resetZoomAndOffset();
     if (!itemListReady || itemListIndex == 0)
     {
+        resetZoomAndOffset();
         return;
     }
+    resetView();
 
     --itemListIndex;
-    if (surroundingPrevReady && surroundingPrev && !surroundingPrev.value().isNull())
+    navigationDirection = -1;
+    if (surroundingPrevReady && surroundingPrev)
     {
-        if (!videoMode)
+        // The current frame takes the other slot over, a decode still running for it is dropped.
+        // A preview still waiting for its full decode is not worth keeping.
+        ++surroundingNextRequest;
+        if (!videoMode && currentFrame && !currentFrame->preview)
         {
-            surroundingNext = currentImage;
+            surroundingNext = currentFrame;
             nextName = target;
+            surroundingNextReady = true;
         }
         else
         {
-            surroundingNext = std::nullopt;
+            surroundingNext = nullptr;
             nextName = FSSTR("");
+            surroundingNextReady = false;
         }
 
         target = prevName;
-        setWindowTitle(fsstrToQstring(getTargetFilename(prevName)));
-        loadImage(&surroundingPrev.value());
+        updateWindowTitle();
+        loadImage(surroundingPrev);
     }
     else
     {
@@ -950,32 +1769,40 @@ void MainWindow::previousItem()
         loadSurroundingNext();
     }
     loadSurroundingPrev();
+    scheduleBackgroundWork();
 }
 
 void MainWindow::nextItem()
 {
-    resetZoomAndOffset();
     if (!itemListReady || (itemListIndex) == itemList.size() - 1)
     {
+        resetZoomAndOffset();
         return;
     }
+    resetView();
     ++itemListIndex;
-    if (surroundingNextReady && surroundingNext.has_value() && !surroundingNext.value().isNull())
+    navigationDirection = 1;
+    if (surroundingNextReady && surroundingNext)
     {
-        if (!videoMode)
+        // The current frame takes the other slot over, a decode still running for it is dropped.
+        // A preview still waiting for its full decode is not worth keeping.
+        ++surroundingPrevRequest;
+        if (!videoMode && currentFrame && !currentFrame->preview)
         {
-            surroundingPrev = currentImage;
+            surroundingPrev = currentFrame;
             prevName = target;
+            surroundingPrevReady = true;
         }
         else
         {
-            surroundingPrev = std::nullopt;
+            surroundingPrev = nullptr;
             prevName = FSSTR("");
+            surroundingPrevReady = false;
         }
 
         target = nextName;
-        setWindowTitle(fsstrToQstring(getTargetFilename(nextName)));
-        loadImage(&surroundingNext.value());
+        updateWindowTitle();
+        loadImage(surroundingNext);
     }
     else
     {
@@ -983,30 +1810,39 @@ void MainWindow::nextItem()
         loadSurroundingPrev();
     }
     loadSurroundingNext();
+    scheduleBackgroundWork();
 }
 
 void MainWindow::loadFirstItem()
 {
-    resetZoomAndOffset();
     if (!itemListReady)
     {
+        resetZoomAndOffset();
         return;
     }
+    resetView();
     itemListIndex = 0;
+    navigationDirection = 1;
+    dropSurroundingFrames();
     reloadTarget();
     loadSurroundingNext();
+    scheduleBackgroundWork();
 }
 
 void MainWindow::loadLastItem()
 {
-    resetZoomAndOffset();
     if (!itemListReady)
     {
+        resetZoomAndOffset();
         return;
     }
+    resetView();
     itemListIndex = itemList.size() - 1;
+    navigationDirection = -1;
+    dropSurroundingFrames();
     reloadTarget();
     loadSurroundingPrev();
+    scheduleBackgroundWork();
 }
 
 void MainWindow::reloadTarget()
@@ -1024,31 +1860,435 @@ void MainWindow::reloadTarget()
 
 void MainWindow::reloadCurrentImage()
 {
-    playImage(&currentImage.value());
+    if (currentFrame)
+    {
+        playImage(currentFrame);
+    }
 }
 
-void MainWindow::setupItemList()
+void MainWindow::setupItemList(ItemList items, ItemColumns columns)
 {
-    namespace stdfs = std::filesystem;
-    std::multimap<long long, stdfs::path> paths;
-    for (const auto& f : stdfs::directory_iterator(currentDir))
+    itemList = std::move(items);
+    itemColumns = std::move(columns);
+
+    itemListIndex = itemList.find(target);
+    itemListReady = true;
+    transcodeQueue->setItems(itemList);
+
+    loadSurroundingNext();
+    loadSurroundingPrev();
+    scheduleBackgroundWork();
+}
+
+void MainWindow::cycleSortOrder()
+{
+    // The duplicate list is ordered by group
+    if (!itemListReady || duplicateMode)
+    {
+        return;
+    }
+
+    sortOrder = getNextSortOrder(sortOrder);
+    showTip(QString("Sort: ") + getSortOrderName(sortOrder));
+
+    if (sortOrder != SortOrder::Captured || itemColumns.hasCaptureTimes())
+    {
+        applySortOrder();
+        return;
+    }
+
+    // Capture dates are only read from the file headers the first time they are needed
+    std::thread([&, items = itemList, generation = itemListGeneration]()
     {
-        fs_str_t ext = getTargetExtension(f.path());
-        if (stdfs::is_regular_file(f)
-            && f.path().has_extension()
-            && validExtensions.count(ext))
+        auto captureTimes = readCaptureTimes(items);
+        QMetaObject::invokeMethod(this, [&, captureTimes = std::move(captureTimes), generation]() mutable
         {
-            paths.insert({ stdfs::last_write_time(f).time_since_epoch().count(), f.path() });
+            if (generation != itemListGeneration)
+            {
+                return;
+            }
+            itemColumns.captureTime = std::move(captureTimes);
+            if (sortOrder == SortOrder::Captured)
+            {
+                applySortOrder();
+            }
+        });
+    }).detach();
+}
+
+void MainWindow::applySortOrder()
+{
+    auto order = getSortedItemOrder(itemList, itemColumns, sortOrder);
+    auto currentPos = std::find(order.begin(), order.end(), itemListIndex) - order.begin();
+
+    applyItemOrder(itemList, itemColumns, order);
+    ++itemListGeneration;
+
+    itemListIndex = currentPos;
+    target = itemList[itemListIndex];
+    transcodeQueue->setItems(itemList);
+
+    loadSurroundingPrev();
+    loadSurroundingNext();
+    scheduleBackgroundWork();
+}
+
+void MainWindow::openSearch()
+{
+    if (!itemListReady)
+    {
+        return;
+    }
+
+    if (searchItemsGeneration != itemListGeneration)
+    {
+        fuzzySearch.setItems(itemList);
+        searchItemsGeneration = itemListGeneration;
+    }
+
+    searchMode = true;
+    searchQuery.clear();
+    searchSelection = 0;
+    updateSearch();
+}
+
+void MainWindow::closeSearch()
+{
+    searchMode = false;
+    searchLabel->setVisible(false);
+}
+
+void MainWindow::handleSearchKey(QKeyEvent* e)
+{
+    switch (e->key())
+    {
+    case Qt::Key_Escape:
+        closeSearch();
+        return;
+
+    case Qt::Key_Return:
+    case Qt::Key_Enter:
+        jumpToSearchResult();
+        return;
+
+    case Qt::Key_Up:
+        if (searchSelection > 0)
+        {
+            --searchSelection;
+            updateSearch();
+        }
+        return;
+
+    case Qt::Key_Down:
+        if (searchSelection + 1 < searchResults.size())
+        {
+            ++searchSelection;
+            updateSearch();
+        }
+        return;
+
+    case Qt::Key_Backspace:
+        if (!searchQuery.isEmpty())
+        {
+            // A whole character, which may be a surrogate pair
+            bool pair = searchQuery.size() >= 2 && searchQuery.at(searchQuery.size() - 1).isLowSurrogate();
+            searchQuery.chop(pair ? 2 : 1);
+            searchSelection = 0;
+            updateSearch();
+        }
+        return;
+
+    default:
+        break;
+    }
+
+    QString text = e->text();
+    if (!text.isEmpty() && text.at(0).isPrint())
+    {
+        searchQuery += text;
+        searchSelection = 0;
+        updateSearch();
+    }
+}
+
+void MainWindow::updateSearch()
+{
+    fuzzySearch.setQuery(qstringToFsstr(searchQuery));
+    searchResults = fuzzySearch.getTopMatches(SEARCH_MAX_RESULTS);
+    searchSelection = std::min(searchSelection, searchResults.empty() ? 0 : searchResults.size() - 1);
+
+    QString text = QString("Search: %1  (%2 matches)").arg(searchQuery).arg(fuzzySearch.getMatchCount());
+    for (size_t i = 0; i < searchResults.size(); ++i)
+    {
+        text += (i == searchSelection ? "\n> " : "\n  ") + fsstrToQstring(fs_str_t(itemList.getName(searchResults[i])));
+    }
+
+    searchLabel->setText(text);
+    searchLabel->adjustSize();
+    searchLabel->move(0, 0);
+    searchLabel->setVisible(true);
+    searchLabel->raise();
+
+    // Get the likely jump target and its neighbours into the page cache while typing
+    if (!searchResults.empty())
+    {
+        size_t selected = searchResults[searchSelection];
+        std::vector<fs_str_t> paths;
+        for (size_t idx = selected > 0 ? selected - 1 : 0; idx <= selected + 1 && idx < itemList.size(); ++idx)
+        {
+            paths.push_back(itemList[idx]);
+        }
+        readahead.schedule(std::move(paths));
+    }
+}
+
+void MainWindow::jumpToSearchResult()
+{
+    if (searchResults.empty() || searchItemsGeneration != itemListGeneration)
+    {
+        closeSearch();
+        return;
+    }
+
+    size_t idx = searchResults[searchSelection];
+    closeSearch();
+    if (idx == itemListIndex)
+    {
+        return;
+    }
+
+    navigationDirection = idx < itemListIndex ? -1 : 1;
+
+    resetView();
+    itemListIndex = idx;
+    target = itemList[itemListIndex];
+    loadItem();
+    loadSurroundingPrev();
+    loadSurroundingNext();
+    scheduleBackgroundWork();
+}
+
+void MainWindow::updateWindowTitle()
+{
+    QString title = fsstrToQstring(getTargetFilename(target));
+    if (duplicateMode && itemListIndex < duplicateGroupOfItem.size())
+    {
+        title = QString("[Duplicates %1/%2] ").arg(duplicateGroupOfItem[itemListIndex] + 1).arg(duplicateGroupCount) + title;
+    }
+    setWindowTitle(title);
+}
+
+void MainWindow::toggleDuplicateMode()
+{
+    // A second hashing pass would only compete with the first one for the cores and the index
+    if (!itemListReady || duplicateSearchRunning)
+    {
+        return;
+    }
+
+    if (duplicateMode)
+    {
+        exitDuplicateMode();
+        return;
+    }
+
+    duplicateSearchRunning = true;
+    showTip("Finding duplicates...");
+    std::thread([this, items = itemList, columns = itemColumns, generation = itemListGeneration]()
+    {
+        auto hashes = computeImageHashes(items, columns, [this](size_t done, size_t total)
+        {
+            QMetaObject::invokeMethod(this, [this, done, total]()
+            {
+                showTip(QString("Hashing images: %1/%2").arg(done).arg(total));
+            });
+        });
+
+        auto groups = findDuplicateGroups(hashes, DUPLICATE_MAX_DISTANCE);
+        QMetaObject::invokeMethod(this, [this, groups = std::move(groups), generation]()
+        {
+            duplicateSearchRunning = false;
+            if (generation == itemListGeneration)
+            {
+                enterDuplicateMode(groups);
+            }
+        });
+    }).detach();
+}
+
+void MainWindow::enterDuplicateMode(const std::vector<std::vector<uint32_t>>& groups)
+{
+    if (groups.empty())
+    {
+        showTip("No duplicates found");
+        return;
+    }
+
+    // Narrow the item list down to the groups, one after the other
+    std::vector<uint32_t> order;
+    duplicateGroupOfItem.clear();
+    for (size_t g = 0; g < groups.size(); ++g)
+    {
+        order.insert(order.end(), groups[g].begin(), groups[g].end());
+        duplicateGroupOfItem.insert(duplicateGroupOfItem.end(), groups[g].size(), g);
+    }
+
+    fullItemList = itemList;
+    fullItemColumns = itemColumns;
+    applyItemOrder(itemList, itemColumns, order);
+    ++itemListGeneration;
+
+    duplicateMode = true;
+    duplicateGroupCount = groups.size();
+    showTip(QString("%1 duplicate groups").arg(groups.size()));
+
+    itemListIndex = 0;
+    target = itemList[itemListIndex];
+    transcodeQueue->setItems(itemList);
+
+    resetView();
+    loadItem();
+    loadSurroundingPrev();
+    loadSurroundingNext();
+    scheduleBackgroundWork();
+}
+
+void MainWindow::exitDuplicateMode()
+{
+    duplicateMode = false;
+    duplicateGroupOfItem.clear();
+
+    itemListIndex = fullItemList.find(target);
+    itemList = std::move(fullItemList);
+    itemColumns = std::move(fullItemColumns);
+
+    applySortOrder();
+    updateWindowTitle();
+}
+
+void MainWindow::skipDuplicateGroup(int direction)
+{
+    size_t group = duplicateGroupOfItem[itemListIndex];
+    if ((direction < 0 && group == 0) || (direction > 0 && group + 1 == duplicateGroupCount))
+    {
+        return;
+    }
+
+    size_t targetGroup = direction < 0 ? group - 1 : group + 1;
+    auto first = std::find(duplicateGroupOfItem.begin(), duplicateGroupOfItem.end(), targetGroup);
+
+    navigationDirection = direction;
+    resetView();
+    itemListIndex = first - duplicateGroupOfItem.begin();
+    target = itemList[itemListIndex];
+    loadItem();
+    loadSurroundingPrev();
+    loadSurroundingNext();
+    scheduleBackgroundWork();
+}
+
+int MainWindow::getFrameIntervalMs() const
+{
+    QScreen* screen = windowHandle() ? windowHandle()->screen() : nullptr;
+    qreal refreshRate = screen ? screen->refreshRate() : 60.0;
+    return std::max(1, static_cast<int>(1000.0 / std::max<qreal>(refreshRate, 1.0)));
+}
+
+void MainWindow::queueNavigation(int steps)
+{
+    // Moves requested by auto-repeat are applied at most once per display frame
+    pendingNavigation += steps;
+    if (!navigationTimer.isActive())
+    {
+        navigationTimer.start(getFrameIntervalMs());
+    }
+}
+
+void MainWindow::applyPendingNavigation()
+{
+    int steps = pendingNavigation;
+    pendingNavigation = 0;
+    if (steps == 0 || !itemListReady)
+    {
+        return;
+    }
+
+    // Stepping onto a prefetched neighbour is just a pixmap swap
+    bool prefetched = steps > 0 ? surroundingNextReady : surroundingPrevReady;
+    if (!fastNavigation && (steps == 1 || steps == -1) && prefetched)
+    {
+        if (steps > 0)
+        {
+            nextItem();
+        }
+        else
+        {
+            previousItem();
         }
+        return;
+    }
+
+    long long lastIdx = static_cast<long long>(itemList.size()) - 1;
+    size_t idx = static_cast<size_t>(std::clamp(static_cast<long long>(itemListIndex) + steps, 0ll, lastIdx));
+    if (idx == itemListIndex)
+    {
+        return;
     }
 
-    itemList.reserve(paths.size());
+    // Items scrolled past are never decoded, the one landed on only at reduced size
+    fastNavigation = true;
+    navigationDirection = steps < 0 ? -1 : 1;
+    dropSurroundingFrames();
+
+    resetView();
+    itemListIndex = idx;
+    target = itemList[itemListIndex];
+    updateWindowTitle();
+    showNavigationPreview();
+}
+
+void MainWindow::showNavigationPreview()
+{
+    size_t generation = ++navigationPreviewGeneration;
+    QSize viewport = getViewportSize();
+    std::thread([this, path = target, generation, viewport, previewSize = viewport / NAVIGATION_PREVIEW_SCALE]()
+    {
+        if (generation != navigationPreviewGeneration || !isImage(path))
+        {
+            return;
+        }
+
+        // The camera's own preview, when the file has one, is cheaper still than a reduced decode
+        FramePtr frame = decodePreviewFrame(path, previewSize, EMBEDDED_PREVIEW_MAX_BYTES);
+        if (!frame)
+        {
+            frame = decodeFrame(path, previewSize);
+        }
+        frame = prepareDisplayFrame(frame, viewport);
+        QMetaObject::invokeMethod(this, [this, frame = std::move(frame), generation]()
+        {
+            if (fastNavigation && generation == navigationPreviewGeneration && frame)
+            {
+                loadImage(frame);
+            }
+        });
+    }).detach();
+}
 
-    for (auto it = paths.rbegin(); it != paths.rend(); ++it)
+void MainWindow::finishFastNavigation()
+{
+    navigationTimer.stop();
+    applyPendingNavigation();
+    if (!fastNavigation)
     {
-        itemList.push_back(it->second);
+        return;
     }
 
-    auto pos = std::find(itemList.begin(), itemList.end(), target) - itemList.begin();
-    itemListIndex = pos;
+    // The item under the cursor is loaded at full quality right away, then its neighbours
+    fastNavigation = false;
+    ++navigationPreviewGeneration;
+    loadItem();
+    loadSurroundingPrev();
+    loadSurroundingNext();
+    scheduleBackgroundWork();
 }
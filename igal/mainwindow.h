@@ -1,5 +1,6 @@
 #pragma once
 
+#include <QtCore/qelapsedtimer.h>
 #include <QtCore/qtimer.h>
 
 #include <QtGui/qpixmap.h>
@@ -15,10 +16,18 @@
 #include <atomic>
 #include <memory>
 #include <mutex>
-#include <optional>
 #include <vector>
 
 #include "defs.h"
+#include "frame.h"
+#include "fuzzysearch.h"
+#include "itemcolumns.h"
+#include "itemlist.h"
+#include "orientation.h"
+#include "readahead.h"
+#include "transcode.h"
+#include "videoframes.h"
+#include "videopreview.h"
 #include "ui_mainwindow.h"
 
 namespace Ui {
@@ -38,34 +47,57 @@ class MainWindow : public QMainWindow
 public:
     explicit MainWindow(const fs_str_t& target, QWidget *parent = nullptr);
 
+    void setResident(bool value);
+    void openTarget(const fs_str_t& requestedTarget);
+
     void keyPressEvent(QKeyEvent* e) override;
+    void keyReleaseEvent(QKeyEvent* e) override;
     void resizeEvent(QResizeEvent* e) override;
+    bool eventFilter(QObject* obj, QEvent* e) override;
+    void closeEvent(QCloseEvent* e) override;
+    void changeEvent(QEvent* e) override;
+    void showEvent(QShowEvent* e) override;
+    void hideEvent(QHideEvent* e) override;
 
 private slots:
     void resizeEnd();
 
 private:
+    void initMultimedia();
+
     void loadItem();
-    void loadImage(QImage* pixmap);
+    void loadImage(FramePtr frame);
     void playImage(const fs_str_t& path);
-    void playImage(QImage* pixmap);
+    void playImage(FramePtr frame);
+    size_t decodeImage(const fs_str_t& path, const QSize& targetSize, bool withPreview);
+    void prepareCurrentFrame();
     void playVideo(const fs_str_t& vpath);
 
     void previousItem();
     void nextItem();
+
+    int getFrameIntervalMs() const;
+    void queueNavigation(int steps);
+    void applyPendingNavigation();
+    void showNavigationPreview();
+    void finishFastNavigation();
     void loadFirstItem();
     void loadLastItem();
 
     void reloadTarget();
     void reloadCurrentImage();
 
-    void setupItemList();
+    void setupItemList(ItemList items, ItemColumns columns);
+    void startItemListSetup();
 
     void loadSurroundingNext();
     void loadSurroundingPrev();
+    void dropSurroundingFrames();
+    void scheduleBackgroundWork();
 
     void showVideoInfo();
     void hideVideoInfo();
+    void updateVideoInfoTimer();
 
     void toggleFullscreen();
     void togglePauseVideo();
@@ -75,17 +107,51 @@ private:
     void skipNext(int amount);
     void rewindVideo(int milliseconds);
     void fforwardVideo(int milliseconds);
+    void seekVideo(qint64 positionMs);
+    void showSeekPreview(qint64 positionMs);
     void increaseVideoSpeed(float v);
     void decreaseVideoSpeed(float v);
     void resetVideoSpeed();
 
+    void stepVideoFrame(int direction);
+    void showSteppedFrame();
+    void requestStepFrames();
+    qint64 getFrameStepBatch() const;
+    void leaveFrameStep();
+
     void copyToDir(const fs_str_t& dir);
+    void showTip(const QString& text);
+
+    void cycleSortOrder();
+    void applySortOrder();
+
+    void toggleDuplicateMode();
+    void enterDuplicateMode(const std::vector<std::vector<uint32_t>>& groups);
+    void exitDuplicateMode();
+    void skipDuplicateGroup(int direction);
+
+    void openSearch();
+    void closeSearch();
+    void handleSearchKey(QKeyEvent* e);
+    void updateSearch();
+    void jumpToSearchResult();
+
+    void exportContactSheet();
+
+    void updateWindowTitle();
 
-    QPixmap getTransformedPixmap(const QPixmap*);
+    QPixmap getTransformedPixmap(const Frame& frame);
 
     void addZoom(float amount);
     void addOffset(float x, float y);
     void resetZoomAndOffset();
+    void resetView();
+    QSize getViewportSize() const;
+    void rescaleSurroundingFrames();
+
+    Orientation getDisplayOrientation() const;
+    void setViewOrientation(const Orientation& orientation);
+    void saveOrientation();
 
     void hideVideo();
     void showVideo();
@@ -99,6 +165,7 @@ private:
     void deleteCurrent();
 
     bool videoMode = false;
+    bool resident = false;
 
     std::unique_ptr<Ui::MainWindow> ui;
     fs_str_t target;
@@ -108,18 +175,59 @@ private:
     std::unique_ptr<QVideoWidget> video;
     std::unique_ptr<QLabel> videoInfoLabel;
     std::unique_ptr<QFontMetrics> videoInfoFontMetrics;
+    QTimer videoInfoTimer;
+    QTimer tipTimer;
+    std::unique_ptr<QLabel> seekPreviewLabel;
+    QTimer seekPreviewTimer;
+
+    std::shared_ptr<VideoPreview> videoPreview;
+    fs_str_t videoPreviewPath;
+
+    // Frame stepping: frames decoded around the playhead, shown over the paused video
+    std::unique_ptr<QLabel> frameStepLabel;
+    VideoStreamInfo videoStream;
+    VideoFrameRing frameRing;
+    QSize frameRingSize;
+    qint64 frameStepIndex = -1;
+    int frameStepDirection = 1;
+    bool frameStepDecoding = false;
+    size_t frameStepGeneration = 0;
 
     std::unordered_map<char, fs_str_t> links;
 
     bool itemListReady = false;
-    std::vector<fs_str_t> itemList;
-
+    ItemList itemList;
+    ItemColumns itemColumns;
+    SortOrder sortOrder = SortOrder::Modified;
+    size_t itemListGeneration = 0;
+
+    // The full item list is set aside while only duplicate groups are browsed
+    bool duplicateMode = false;
+    bool duplicateSearchRunning = false;
+    ItemList fullItemList;
+    ItemColumns fullItemColumns;
+    std::vector<size_t> duplicateGroupOfItem;
+    size_t duplicateGroupCount = 0;
+
+    // Ctrl+F filename search: keys go to the query while it is open
+    bool searchMode = false;
+    QString searchQuery;
+    FuzzySearch fuzzySearch;
+    size_t searchItemsGeneration = 0;
+    std::vector<uint32_t> searchResults;
+    size_t searchSelection = 0;
+    std::unique_ptr<QLabel> searchLabel;
+
+    // Prefetched neighbours, only touched on the UI thread. A decode publishes its
+    // frame only while its request is still the latest one for the slot.
     std::mutex surroundingNextMux, surroundingPrevMux;
-    std::optional<QImage> surroundingNext;
-    std::optional<QImage> surroundingPrev;
-    std::optional<QImage> currentImage;
-    std::atomic<bool> surroundingNextReady = false;
-    std::atomic<bool> surroundingPrevReady = false;
+    std::atomic<size_t> surroundingNextRequest = 0;
+    std::atomic<size_t> surroundingPrevRequest = 0;
+    FramePtr surroundingNext;
+    FramePtr surroundingPrev;
+    FramePtr currentFrame;
+    bool surroundingNextReady = false;
+    bool surroundingPrevReady = false;
     fs_str_t prevName;
     fs_str_t nextName;
 
@@ -127,7 +235,29 @@ private:
     float currentY = 0;
     float zoom = 1.0F;
 
+    // User rotation/flip, on top of the frame's own EXIF orientation
+    Orientation viewOrientation;
+
     size_t itemListIndex = 0;
+    int navigationDirection = 1;
+
+    // Key auto-repeat: moves pending for the next frame, and whether items are being skipped
+    int pendingNavigation = 0;
+    bool fastNavigation = false;
+    std::atomic<size_t> navigationPreviewGeneration = 0;
+
+    // Bumped whenever another image is shown, so that a late full decode is dropped
+    std::atomic<size_t> imageDecodeGeneration = 0;
+
+    // The decode started for zooming into a reduced frame, so that it is started only once
+    size_t fullDecodeGeneration = 0;
+    QTimer navigationTimer;
+
+    Readahead readahead;
+    std::unique_ptr<TranscodeQueue> transcodeQueue;
 
     QTimer resizeTimer;
+
+    QElapsedTimer startupTimer;
+    bool firstImagePainted = false;
 };
@@ -0,0 +1,171 @@
+#include "mediatypes.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "archive.h"
+#include "dirscan.h"
+#include "fsutils.h"
+
+// Shown through the JPEG previews embedded by the camera
+const std::unordered_set<fs_str_t> rawImageExtensions = {
+    FSSTR(".arw"),
+    FSSTR(".cr2"),
+    FSSTR(".dng"),
+    FSSTR(".nef"),
+    FSSTR(".nrw"),
+    FSSTR(".pef"),
+    FSSTR(".raf"),
+    FSSTR(".srw")
+};
+
+std::unordered_set<fs_str_t> getImageExtensions()
+{
+    std::unordered_set<fs_str_t> result = {
+        FSSTR(".jpg"),
+        FSSTR(".jpeg"),
+        FSSTR(".png"),
+        FSSTR(".tga"),
+        FSSTR(".tiff"),
+        FSSTR(".webp")
+    };
+    result.insert(rawImageExtensions.begin(), rawImageExtensions.end());
+    return result;
+}
+
+const std::unordered_set<fs_str_t> imageExtensions = getImageExtensions();
+
+const std::unordered_set<fs_str_t> animationExtensions = {
+    FSSTR(".png"),
+    FSSTR(".gif")
+};
+
+const std::unordered_set<fs_str_t> videoExtensions = {
+    FSSTR(".avi"),
+    FSSTR(".m4v"),
+    FSSTR(".mp4"),
+    FSSTR(".webm"),
+
+#if defined(WIN32) || defined(_WIN32)
+    FSSTR(".wmv"),
+#endif
+};
+
+std::unordered_set<fs_str_t> getValidExtensions()
+{
+    std::unordered_set<fs_str_t> result;
+
+    std::copy(imageExtensions.begin(), imageExtensions.end(), std::inserter(result, result.begin()));
+    std::copy(animationExtensions.begin(), animationExtensions.end(), std::inserter(result, result.begin()));
+    std::copy(videoExtensions.begin(), videoExtensions.end(), std::inserter(result, result.begin()));
+
+    return result;
+}
+
+const std::unordered_set<fs_str_t> validExtensions = getValidExtensions();
+
+std::vector<fs_str_t> getSortedValidExtensions()
+{
+    std::vector<fs_str_t> result(validExtensions.begin(), validExtensions.end());
+    std::sort(result.begin(), result.end());
+    return result;
+}
+
+const std::vector<fs_str_t> sortedValidExtensions = getSortedValidExtensions();
+
+uint8_t getExtensionId(const fs_str_t& ext)
+{
+    auto it = std::lower_bound(sortedValidExtensions.begin(), sortedValidExtensions.end(), ext);
+    return static_cast<uint8_t>(it - sortedValidExtensions.begin());
+}
+
+bool isAnimatedPng(const fs_str_t& target)
+{
+    std::ifstream ifs(target, std::ios::binary);
+    ifs >> std::noskipws;
+
+    std::string data(4096, 0);
+    ifs.read(data.data(), data.size());
+
+    return data.find("acTL") != std::string::npos;
+}
+
+bool isImage(const fs_str_t& target)
+{
+    fs_str_t ext = getTargetExtension(target);
+    if (imageExtensions.count(ext))
+    {
+        if (ext != FSSTR(".png"))
+        {
+            return true;
+        }
+        else
+        {
+            return !isAnimatedPng(target);
+        }
+    }
+    return false;
+}
+
+bool isRawImage(const fs_str_t& target)
+{
+    return rawImageExtensions.count(getTargetExtension(target)) != 0;
+}
+
+bool isAnimation(const fs_str_t& target)
+{
+    fs_str_t ext = getTargetExtension(target);
+    if (animationExtensions.count(ext))
+    {
+        if (ext != FSSTR(".png"))
+        {
+            return true;
+        }
+        else
+        {
+            return isAnimatedPng(target);
+        }
+    }
+    return false;
+}
+
+bool isVideo(const fs_str_t& target)
+{
+    return videoExtensions.count(getTargetExtension(target));
+}
+
+void scanMediaItems(const fs_str_t& dir, ItemList& items, ItemColumns& columns)
+{
+    // Archive members can't be handed to ffmpeg or the media player: only still images are listed
+    fs_str_t archivePath;
+    fs_str_t memberPath;
+    auto entries = splitArchivePath(dir, archivePath, memberPath)
+        ? scanArchive(archivePath, [](const fs_str_t& name)
+            {
+                return imageExtensions.count(getTargetExtension(name)) > 0;
+            })
+        : scanDirectory(dir, [](const fs_str_t& filename)
+            {
+                return validExtensions.count(getTargetExtension(filename)) > 0;
+            });
+
+    size_t nameChars = 0;
+    for (const auto& entry : entries)
+    {
+        nameChars += entry.name.size();
+    }
+
+    items.clear();
+    items.setDirectory(dir);
+    items.reserve(entries.size(), nameChars);
+    columns = ItemColumns();
+    columns.reserve(entries.size());
+    for (const auto& entry : entries)
+    {
+        columns.push(entry.mtime, entry.size, getExtensionId(getTargetExtension(entry.name)));
+        items.push(entry.name);
+    }
+}
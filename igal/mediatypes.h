@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstdint>
+#include <unordered_set>
+
+#include "defs.h"
+#include "itemcolumns.h"
+#include "itemlist.h"
+
+extern const std::unordered_set<fs_str_t> rawImageExtensions;
+extern const std::unordered_set<fs_str_t> imageExtensions;
+extern const std::unordered_set<fs_str_t> animationExtensions;
+extern const std::unordered_set<fs_str_t> videoExtensions;
+extern const std::unordered_set<fs_str_t> validExtensions;
+
+// Compact id of a valid extension, ordered by extension name
+uint8_t getExtensionId(const fs_str_t& ext);
+
+bool isAnimatedPng(const fs_str_t& target);
+
+bool isImage(const fs_str_t& target);
+bool isRawImage(const fs_str_t& target);
+bool isAnimation(const fs_str_t& target);
+bool isVideo(const fs_str_t& target);
+
+// Lists the media files of 'dir' (which may be an archive root), in directory order, with their sort keys
+void scanMediaItems(const fs_str_t& dir, ItemList& items, ItemColumns& columns);
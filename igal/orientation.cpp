@@ -0,0 +1,70 @@
+#include "orientation.h"
+
+#include <QtGui/qtransform.h>
+
+// EXIF values 1-8 as mirror-then-rotate pairs
+const Orientation EXIF_ORIENTATIONS[8] = {
+    { 0, false },
+    { 0, true },
+    { 2, false },
+    { 2, true },
+    { 3, true },
+    { 1, false },
+    { 1, true },
+    { 3, false }
+};
+
+Orientation fromExifOrientation(int value)
+{
+    return (value >= 1 && value <= 8) ? EXIF_ORIENTATIONS[value - 1] : Orientation();
+}
+
+int toExifOrientation(const Orientation& orientation)
+{
+    for (int i = 0; i < 8; ++i)
+    {
+        if (EXIF_ORIENTATIONS[i].quarterTurns == orientation.quarterTurns
+            && EXIF_ORIENTATIONS[i].mirrored == orientation.mirrored)
+        {
+            return i + 1;
+        }
+    }
+    return 1;
+}
+
+Orientation combineOrientations(const Orientation& first, const Orientation& then)
+{
+    // A mirror commutes with a rotation by reversing its direction
+    int turns = then.quarterTurns + (then.mirrored ? -first.quarterTurns : first.quarterTurns);
+    return { ((turns % 4) + 4) % 4, first.mirrored != then.mirrored };
+}
+
+Orientation rotateClockwise(const Orientation& orientation)
+{
+    return combineOrientations(orientation, { 1, false });
+}
+
+Orientation rotateCounterClockwise(const Orientation& orientation)
+{
+    return combineOrientations(orientation, { 3, false });
+}
+
+Orientation flipHorizontally(const Orientation& orientation)
+{
+    return combineOrientations(orientation, { 0, true });
+}
+
+Orientation flipVertically(const Orientation& orientation)
+{
+    return combineOrientations(orientation, { 2, true });
+}
+
+QImage applyOrientation(const QImage& image, const Orientation& orientation)
+{
+    QImage result = orientation.mirrored ? image.mirrored(true, false) : image;
+    if (orientation.quarterTurns != 0)
+    {
+        result = result.transformed(QTransform().rotate(90.0 * orientation.quarterTurns));
+    }
+    return result;
+}
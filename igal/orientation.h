@@ -0,0 +1,32 @@
+#pragma once
+
+#include <QtGui/qimage.h>
+
+// How an image is turned for display: mirrored horizontally first (in image
+// space), then rotated clockwise by quarter turns. Covers the eight EXIF
+// orientations as well as any sequence of user rotations and flips.
+struct Orientation
+{
+    int quarterTurns = 0;
+    bool mirrored = false;
+
+    bool isIdentity() const { return quarterTurns == 0 && !mirrored; }
+
+    // Width and height swap places on screen
+    bool isTransposed() const { return quarterTurns % 2 != 0; }
+};
+
+// EXIF orientation tag value (1-8); anything else is treated as 1
+Orientation fromExifOrientation(int value);
+int toExifOrientation(const Orientation& orientation);
+
+// 'first', then 'then' applied on top of the result
+Orientation combineOrientations(const Orientation& first, const Orientation& then);
+
+Orientation rotateClockwise(const Orientation& orientation);
+Orientation rotateCounterClockwise(const Orientation& orientation);
+Orientation flipHorizontally(const Orientation& orientation);
+Orientation flipVertically(const Orientation& orientation);
+
+// Uses Qt's fast paths for mirroring and quarter turns
+QImage applyOrientation(const QImage& image, const Orientation& orientation);
@@ -0,0 +1,247 @@
+#include "pixelcache.h"
+
+#include <QtCore/qglobal.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "cachestore.h"
+#include "decoder.h"
+#include "fsutils.h"
+#include "mappedfile.h"
+
+const fs_str_t PIXEL_CACHE_SUFFIX = FSSTR(".pix");
+
+// The pixels start one page into the file, so the mapping is page aligned
+const size_t PIXEL_CACHE_HEADER_SIZE = 4096;
+const char PIXEL_CACHE_MAGIC[8] = { 'I', 'G', 'A', 'L', 'P', 'I', 'X', '1' };
+
+// Decodes faster than this are never worth a disk write
+const double PIXEL_CACHE_MIN_DECODE_MS = 30.0;
+
+// A decode has to take this many times longer than reading the raw pixels back
+const double PIXEL_CACHE_MIN_GAIN = 2.0;
+
+// Conservative read speed for the raw pixels (bytes per millisecond, ~100 MB/s)
+const double PIXEL_CACHE_READ_BYTES_PER_MS = 100.0 * 1000.0;
+
+// Weight of the latest decode in the per-extension running average
+const double PIXEL_CACHE_GAIN_SMOOTHING = 0.25;
+
+struct PixelCacheHeader
+{
+    char magic[8];
+    uint32_t width;
+    uint32_t height;
+    uint32_t bytesPerLine;
+    uint32_t format;
+    uint32_t reduced;
+    uint32_t orientation;
+};
+
+// Running average of decode time over raw read time, per extension.
+// Extensions without measurements yet are looked up too.
+std::mutex gainMux;
+std::unordered_map<fs_str_t, double> gainByExtension;
+
+bool isPixelCacheEnabled()
+{
+    static const bool enabled = qEnvironmentVariable("IGAL_PIXEL_CACHE") != "0";
+    return enabled;
+}
+
+bool isWorthLookingUp(const fs_str_t& ext)
+{
+    std::lock_guard lock(gainMux);
+    auto it = gainByExtension.find(ext);
+    return it == gainByExtension.end() || it->second >= PIXEL_CACHE_MIN_GAIN;
+}
+
+double getRawReadMs(const QImage& image)
+{
+    return static_cast<double>(image.sizeInBytes()) / PIXEL_CACHE_READ_BYTES_PER_MS;
+}
+
+double getDecodeGain(const QImage& image, double decodeMs)
+{
+    return decodeMs / std::max(getRawReadMs(image), 1.0);
+}
+
+bool isWorthStoring(double decodeMs, double gain)
+{
+    return decodeMs >= PIXEL_CACHE_MIN_DECODE_MS && gain >= PIXEL_CACHE_MIN_GAIN;
+}
+
+fs_str_t getPixelCachePath(const std::string& key, const QSize& targetSize)
+{
+    std::string sizedKey = key + "-" + std::to_string(targetSize.width()) + "x" + std::to_string(targetSize.height());
+    return getCachePath(sizedKey, PIXEL_CACHE_SUFFIX);
+}
+
+void unmapCachedFrame(void* info)
+{
+    delete static_cast<MappedFile*>(info);
+}
+
+FramePtr loadCachedFrame(const fs_str_t& path, const QSize& targetSize)
+{
+    if (!isPixelCacheEnabled() || targetSize.isEmpty() || !isWorthLookingUp(getTargetExtension(path)))
+    {
+        return nullptr;
+    }
+
+    std::string key = getContentKey(path);
+    if (key.empty())
+    {
+        return nullptr;
+    }
+
+    fs_str_t cachePath = getPixelCachePath(key, targetSize);
+    if (!useCacheFile(cachePath))
+    {
+        return nullptr;
+    }
+
+    auto file = std::make_unique<MappedFile>(cachePath);
+    if (!file->isValid() || file->size() < PIXEL_CACHE_HEADER_SIZE)
+    {
+        return nullptr;
+    }
+
+    PixelCacheHeader header;
+    std::memcpy(&header, file->data(), sizeof(header));
+
+    auto format = static_cast<QImage::Format>(header.format);
+    if (!std::equal(header.magic, header.magic + sizeof(header.magic), PIXEL_CACHE_MAGIC)
+        || (format != QImage::Format_RGB32 && format != QImage::Format_ARGB32_Premultiplied)
+        || header.bytesPerLine < header.width * 4
+        || file->size() != PIXEL_CACHE_HEADER_SIZE + uint64_t(header.bytesPerLine) * header.height)
+    {
+        return nullptr;
+    }
+    file->adviseWillNeed(PIXEL_CACHE_HEADER_SIZE, file->size() - PIXEL_CACHE_HEADER_SIZE);
+
+    // The image reads straight from the mapping, which lives as long as the image does
+    const uint8_t* pixels = file->data() + PIXEL_CACHE_HEADER_SIZE;
+    QImage image(pixels, header.width, header.height, header.bytesPerLine, format, unmapCachedFrame, file.get());
+    if (image.isNull())
+    {
+        return nullptr;
+    }
+    file.release();
+
+    auto frame = std::make_shared<Frame>();
+    frame->image = std::move(image);
+    frame->reduced = header.reduced != 0;
+    frame->orientation = fromExifOrientation(header.orientation);
+    return frame;
+}
+
+void storeCachedFrame(const fs_str_t& path, const QSize& targetSize, FramePtr frame)
+{
+    std::string key = getContentKey(path);
+    if (key.empty())
+    {
+        return;
+    }
+
+    fs_str_t cachePath = getPixelCachePath(key, targetSize);
+    fs_str_t tempPath = getCacheTempPath(cachePath);
+
+    const QImage& image = frame->image;
+
+    PixelCacheHeader header = {};
+    std::copy(PIXEL_CACHE_MAGIC, PIXEL_CACHE_MAGIC + sizeof(PIXEL_CACHE_MAGIC), header.magic);
+    header.width = image.width();
+    header.height = image.height();
+    header.bytesPerLine = image.bytesPerLine();
+    header.format = image.format();
+    header.reduced = frame->reduced;
+    header.orientation = toExifOrientation(frame->orientation);
+
+    std::vector<char> headerPage(PIXEL_CACHE_HEADER_SIZE, 0);
+    std::memcpy(headerPage.data(), &header, sizeof(header));
+
+    {
+        std::ofstream ofs(tempPath, std::ios::binary);
+        ofs.write(headerPage.data(), headerPage.size());
+        ofs.write(reinterpret_cast<const char*>(image.constBits()), image.sizeInBytes());
+        if (!ofs)
+        {
+            ofs.close();
+            std::error_code ec;
+            std::filesystem::remove(tempPath, ec);
+            return;
+        }
+    }
+    commitCacheFile(tempPath, cachePath);
+}
+
+void reportDecodedFrame(const fs_str_t& path, const QSize& targetSize, FramePtr frame, double decodeMs)
+{
+    if (!isPixelCacheEnabled() || targetSize.isEmpty() || !frame)
+    {
+        return;
+    }
+
+    double gain = getDecodeGain(frame->image, decodeMs);
+    {
+        std::lock_guard lock(gainMux);
+        auto [it, inserted] = gainByExtension.emplace(getTargetExtension(path), gain);
+        if (!inserted)
+        {
+            it->second += (gain - it->second) * PIXEL_CACHE_GAIN_SMOOTHING;
+        }
+    }
+
+    if (!isWorthStoring(decodeMs, gain))
+    {
+        return;
+    }
+
+    // Writing out the pixels shouldn't hold up the prefetch that decoded them
+    std::thread([path, targetSize, frame = std::move(frame)]()
+    {
+        storeCachedFrame(path, targetSize, frame);
+    }).detach();
+}
+
+bool prebuildCachedFrame(const fs_str_t& path, const QSize& targetSize)
+{
+    if (!isPixelCacheEnabled() || targetSize.isEmpty())
+    {
+        return true;
+    }
+
+    std::string key = getContentKey(path);
+    if (key.empty())
+    {
+        return false;
+    }
+    if (useCacheFile(getPixelCachePath(key, targetSize)))
+    {
+        return true;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    FramePtr frame = makeFrame(decodeImage(path, targetSize));
+    double decodeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    if (!frame)
+    {
+        return false;
+    }
+
+    // Stored in place of the viewer's background write: the caller may exit right after
+    if (isWorthStoring(decodeMs, getDecodeGain(frame->image, decodeMs)))
+    {
+        storeCachedFrame(path, targetSize, frame);
+    }
+    return true;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <QtCore/qsize.h>
+
+#include "defs.h"
+#include "frame.h"
+
+// Disk tier for formats that are much slower to decode than to read (large
+// PNGs, TIFF, lossless WebP...). Frames decoded for a given display size are
+// stored as raw pixels behind a page-sized header, so a revisit maps the file
+// straight into a QImage instead of decoding again. Entries live in the shared
+// cache directory (see cachestore.h), under its size cap and LRU eviction.
+//
+// Which frames are worth storing is decided from measured decode times, per
+// file extension. Set IGAL_PIXEL_CACHE=0 to disable.
+
+// Null if there is no entry for the file at this size (or the cache is disabled)
+FramePtr loadCachedFrame(const fs_str_t& path, const QSize& targetSize);
+
+// Records how long decoding 'frame' took, and stores it in the background if
+// that was slow enough to be worth it
+void reportDecodedFrame(const fs_str_t& path, const QSize& targetSize, FramePtr frame, double decodeMs);
+
+// Decodes the file for 'targetSize' the way the viewer does and stores the frame
+// right away if the decode is slow enough to be worth it, so that the first visit
+// is served from the cache too. For 'igal --warm'; call from a worker thread.
+// False if the file can't be decoded.
+bool prebuildCachedFrame(const fs_str_t& path, const QSize& targetSize);
@@ -0,0 +1,240 @@
+#include "../dirscan.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef IGAL_HAVE_LIBURING
+	#include <liburing.h>
+#endif
+
+const size_t STAT_ITEMS_PER_THREAD = 64;
+const size_t STAT_MAX_THREADS = 32;
+
+// A first stat this slow means a network mount (or a cold disk): every entry then gets a thread, up to the limit
+const auto STAT_SLOW_LATENCY = std::chrono::microseconds(200);
+
+#ifdef IGAL_HAVE_LIBURING
+const unsigned URING_QUEUE_DEPTH = 256;
+#endif
+
+struct ScanCandidate
+{
+	fs_str_t name;
+	bool isRegular = false;
+	long long mtime = 0;
+	uint64_t size = 0;
+};
+
+#ifdef IGAL_HAVE_LIBURING
+
+// Submits statx for the whole batch and reaps the completions as they arrive.
+// Returns false if io_uring (or its statx opcode) is unavailable on this kernel.
+bool statCandidatesUring(int dirfd, std::vector<ScanCandidate>& candidates)
+{
+	io_uring ring;
+	if (io_uring_queue_init(URING_QUEUE_DEPTH, &ring, 0) < 0)
+	{
+		return false;
+	}
+
+	std::vector<struct statx> results(candidates.size());
+	size_t submitted = 0;
+	size_t completed = 0;
+	bool ok = true;
+
+	while (completed < submitted || (ok && submitted < candidates.size()))
+	{
+		while (ok && submitted < candidates.size() && submitted - completed < URING_QUEUE_DEPTH)
+		{
+			io_uring_sqe* sqe = io_uring_get_sqe(&ring);
+			if (!sqe)
+			{
+				break;
+			}
+
+			io_uring_prep_statx(
+				sqe,
+				dirfd,
+				candidates[submitted].name.c_str(),
+				0,
+				STATX_TYPE | STATX_SIZE | STATX_MTIME,
+				&results[submitted]
+			);
+			io_uring_sqe_set_data(sqe, reinterpret_cast<void*>(static_cast<uintptr_t>(submitted)));
+			++submitted;
+		}
+
+		int ret = io_uring_submit_and_wait(&ring, 1);
+		if (ret < 0 && ret != -EINTR && ret != -EAGAIN)
+		{
+			// SQEs the kernel never took won't complete
+			submitted -= io_uring_sq_ready(&ring);
+			ok = false;
+			break;
+		}
+
+		io_uring_cqe* cqe;
+		unsigned head;
+		unsigned count = 0;
+		io_uring_for_each_cqe(&ring, head, cqe)
+		{
+			auto idx = static_cast<size_t>(reinterpret_cast<uintptr_t>(io_uring_cqe_get_data(cqe)));
+			if (cqe->res == -EINVAL || cqe->res == -EOPNOTSUPP)
+			{
+				ok = false;
+			}
+			else if (cqe->res == 0)
+			{
+				const auto& stx = results[idx];
+				candidates[idx].isRegular = S_ISREG(stx.stx_mode);
+				candidates[idx].size = stx.stx_size;
+				candidates[idx].mtime = stx.stx_mtime.tv_sec * 1000000000ll + stx.stx_mtime.tv_nsec;
+			}
+			++count;
+		}
+		io_uring_cq_advance(&ring, count);
+		completed += count;
+	}
+
+	// The kernel writes into 'results' until every statx it took has completed
+	while (completed < submitted)
+	{
+		io_uring_cqe* cqe;
+		int ret = io_uring_wait_cqe(&ring, &cqe);
+		if (ret == -EINTR)
+		{
+			continue;
+		}
+		if (ret < 0)
+		{
+			break;
+		}
+		io_uring_cqe_seen(&ring, cqe);
+		++completed;
+	}
+
+	io_uring_queue_exit(&ring);
+
+	if (completed < submitted)
+	{
+		// Leaked on purpose: statx calls still in flight may write into it
+		new std::vector<struct statx>(std::move(results));
+	}
+	return ok;
+}
+
+#endif
+
+void statCandidate(int dirfd, ScanCandidate& candidate)
+{
+	struct stat st;
+	if (fstatat(dirfd, candidate.name.c_str(), &st, 0) != 0)
+	{
+		return;
+	}
+
+	candidate.isRegular = S_ISREG(st.st_mode);
+	candidate.size = st.st_size;
+#if defined(__APPLE__)
+	candidate.mtime = st.st_mtimespec.tv_sec * 1000000000ll + st.st_mtimespec.tv_nsec;
+#else
+	candidate.mtime = st.st_mtim.tv_sec * 1000000000ll + st.st_mtim.tv_nsec;
+#endif
+}
+
+void statCandidatesThreaded(int dirfd, std::vector<ScanCandidate>& candidates)
+{
+	if (candidates.empty())
+	{
+		return;
+	}
+
+	// Blocking stat calls are latency bound on network mounts, so run many in flight there,
+	// however small the directory. Local ones only fan out for large directories.
+	auto start = std::chrono::steady_clock::now();
+	statCandidate(dirfd, candidates[0]);
+	bool slow = std::chrono::steady_clock::now() - start > STAT_SLOW_LATENCY;
+
+	size_t itemsPerThread = slow ? 1 : STAT_ITEMS_PER_THREAD;
+	size_t threadCount = std::clamp<size_t>((candidates.size() - 1) / itemsPerThread, 1, STAT_MAX_THREADS);
+	std::atomic<size_t> next = 1;
+
+	auto work = [&]()
+	{
+		size_t idx;
+		while ((idx = next++) < candidates.size())
+		{
+			statCandidate(dirfd, candidates[idx]);
+		}
+	};
+
+	std::vector<std::thread> threads;
+	for (size_t i = 1; i < threadCount; ++i)
+	{
+		threads.emplace_back(work);
+	}
+	work();
+
+	for (auto& t : threads)
+	{
+		t.join();
+	}
+}
+
+std::vector<ScanEntry> scanDirectory(const fs_str_t& dir, const std::function<bool(const fs_str_t&)>& filter)
+{
+	std::vector<ScanEntry> result;
+
+	DIR* dirStream = opendir(dir.empty() ? "." : dir.c_str());
+	if (!dirStream)
+	{
+		return result;
+	}
+
+	// Names only at first: entries are filtered before any metadata is requested
+	std::vector<ScanCandidate> candidates;
+	while (dirent* entry = readdir(dirStream))
+	{
+		if (entry->d_type == DT_DIR)
+		{
+			continue;
+		}
+
+		fs_str_t name = entry->d_name;
+		if (filter(name))
+		{
+			candidates.push_back({ std::move(name) });
+		}
+	}
+
+	int dirfd = ::dirfd(dirStream);
+
+#ifdef IGAL_HAVE_LIBURING
+	if (!statCandidatesUring(dirfd, candidates))
+	{
+		statCandidatesThreaded(dirfd, candidates);
+	}
+#else
+	statCandidatesThreaded(dirfd, candidates);
+#endif
+
+	closedir(dirStream);
+
+	result.reserve(candidates.size());
+	for (auto& candidate : candidates)
+	{
+		if (candidate.isRegular)
+		{
+			result.push_back({ std::move(candidate.name), candidate.mtime, candidate.size });
+		}
+	}
+	return result;
+}
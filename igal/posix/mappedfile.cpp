@@ -0,0 +1,62 @@
+#include "../mappedfile.h"
+
+#include <algorithm>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::MappedFile(const fs_str_t& path)
+{
+	fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+	{
+		return;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size <= 0)
+	{
+		return;
+	}
+
+	void* addr = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (addr == MAP_FAILED)
+	{
+		return;
+	}
+
+	mappedData = static_cast<const uint8_t*>(addr);
+	mappedSize = st.st_size;
+}
+
+MappedFile::~MappedFile()
+{
+	if (mappedData)
+	{
+		munmap(const_cast<uint8_t*>(mappedData), mappedSize);
+	}
+	if (fd >= 0)
+	{
+		close(fd);
+	}
+}
+
+void MappedFile::adviseWillNeed(size_t offset, size_t length) const
+{
+	if (!mappedData || offset >= mappedSize)
+	{
+		return;
+	}
+	length = std::min(length, mappedSize - offset);
+
+#if defined(__linux__)
+	posix_fadvise(fd, offset, length, POSIX_FADV_WILLNEED);
+#endif
+
+	// madvise wants a page-aligned start address
+	size_t pageSize = sysconf(_SC_PAGESIZE);
+	size_t alignedOffset = offset - offset % pageSize;
+	madvise(const_cast<uint8_t*>(mappedData) + alignedOffset, length + (offset - alignedOffset), MADV_WILLNEED);
+}
@@ -0,0 +1,525 @@
+#include "../sharedframes.h"
+
+#include <QtCore/qglobal.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../hash.h"
+
+// Bumped with any change to the index or entry layout: the version is part of the index name
+const int SHARED_INDEX_VERSION = 1;
+
+const size_t SHARED_SLOT_COUNT = 1024;
+
+// Slots an entry may be placed in, starting from its key's home slot
+const size_t SHARED_PROBE_LENGTH = 16;
+
+// The pixels start one page into an entry, so they stay page aligned
+const size_t SHARED_FRAME_HEADER_SIZE = 4096;
+const char SHARED_FRAME_MAGIC[8] = { 'I', 'G', 'A', 'L', 'S', 'H', 'M', '1' };
+
+// A slot locked for this long belongs to a writer that died
+const uint64_t SHARED_STALE_LOCK_MS = 30000;
+
+// Slot state: the version in the high bits, the count of processes mapping it in
+// the low ones. The version grows by one when a writer takes the slot (odd: being
+// written) and by one when it is done, so every entry a slot ever held has its own.
+const int SHARED_REF_BITS = 24;
+const uint64_t SHARED_REF_MASK = (uint64_t(1) << SHARED_REF_BITS) - 1;
+
+struct SharedSlot
+{
+	std::atomic<uint64_t> state;
+
+	// 0 for an empty slot
+	std::atomic<uint64_t> key;
+	std::atomic<uint64_t> bytes;
+	std::atomic<uint64_t> lastUse;
+	std::atomic<uint64_t> lockedAtMs;
+};
+
+// Zero-filled on creation, which is a valid empty index
+struct SharedIndex
+{
+	std::atomic<uint64_t> clock;
+	std::atomic<uint64_t> totalBytes;
+	SharedSlot slots[SHARED_SLOT_COUNT];
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "shared memory needs address-free atomics");
+
+struct SharedFrameHeader
+{
+	char magic[8];
+	uint64_t key;
+	uint32_t width;
+	uint32_t height;
+	uint32_t bytesPerLine;
+	uint32_t format;
+	uint32_t reduced;
+	uint32_t orientation;
+};
+
+// What a mapped entry needs to let go of its slot once the image is gone
+struct SharedMapping
+{
+	SharedIndex* index;
+	size_t slot;
+	uint64_t version;
+	void* addr;
+	size_t size;
+};
+
+uint64_t getSharedBudget()
+{
+	static const uint64_t budget = uint64_t(std::max(0, qEnvironmentVariableIntValue("IGAL_SHARED_CACHE_MB"))) * 1024 * 1024;
+	return budget;
+}
+
+uint64_t getVersion(uint64_t state)
+{
+	return state >> SHARED_REF_BITS;
+}
+
+uint64_t getWallClockMs()
+{
+	return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+// Short names: macOS allows 31 characters
+std::string getSharedName(const std::string& suffix)
+{
+	char prefix[32];
+	snprintf(prefix, sizeof(prefix), "/igal%x-%d-", static_cast<unsigned>(getuid()), SHARED_INDEX_VERSION);
+	return prefix + suffix;
+}
+
+std::string getEntryName(size_t slot, uint64_t writeVersion)
+{
+	char suffix[32];
+	snprintf(suffix, sizeof(suffix), "%zx-%llx", slot, static_cast<unsigned long long>(writeVersion));
+	return getSharedName(suffix);
+}
+
+SharedIndex* openSharedIndex()
+{
+	if (getSharedBudget() == 0)
+	{
+		return nullptr;
+	}
+
+	std::string name = getSharedName("index");
+	int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+	if (fd < 0)
+	{
+		return nullptr;
+	}
+
+	// Every process sizes it: extending a fresh object is a no-op for the others
+	struct stat st;
+	void* addr = MAP_FAILED;
+	if (fstat(fd, &st) == 0 && (st.st_size >= off_t(sizeof(SharedIndex)) || ftruncate(fd, sizeof(SharedIndex)) == 0))
+	{
+		addr = mmap(nullptr, sizeof(SharedIndex), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	}
+	close(fd);
+
+	return addr != MAP_FAILED ? static_cast<SharedIndex*>(addr) : nullptr;
+}
+
+SharedIndex* getSharedIndex()
+{
+	static SharedIndex* const index = openSharedIndex();
+	return index;
+}
+
+// Path, inode, mtime and ctime to the nanosecond and file size, plus the size the frame
+// was decoded for. The ctime catches rewrites that keep the mtime (as saving a rotation
+// does) and the size. 0 if the file can't be found.
+uint64_t getFrameKey(const fs_str_t& path, const QSize& targetSize)
+{
+	struct stat st;
+	if (stat(path.c_str(), &st) != 0)
+	{
+		return 0;
+	}
+
+#if defined(__APPLE__)
+	const struct timespec& mtime = st.st_mtimespec;
+	const struct timespec& ctime = st.st_ctimespec;
+#else
+	const struct timespec& mtime = st.st_mtim;
+	const struct timespec& ctime = st.st_ctim;
+#endif
+
+	uint64_t fields[] = {
+		uint64_t(st.st_dev),
+		uint64_t(st.st_ino),
+		uint64_t(mtime.tv_sec),
+		uint64_t(mtime.tv_nsec),
+		uint64_t(ctime.tv_sec),
+		uint64_t(ctime.tv_nsec),
+		uint64_t(st.st_size),
+		uint64_t(targetSize.width()),
+		uint64_t(targetSize.height()),
+	};
+	uint64_t key = xxHash64(path.data(), path.size(), xxHash64(fields, sizeof(fields)));
+	return key != 0 ? key : 1;
+}
+
+bool acquireSlot(SharedSlot& slot, uint64_t version)
+{
+	uint64_t state = slot.state.load(std::memory_order_acquire);
+	while (getVersion(state) == version && (state & SHARED_REF_MASK) < SHARED_REF_MASK)
+	{
+		if (slot.state.compare_exchange_weak(state, state + 1, std::memory_order_acq_rel))
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+// A no-op if the entry has been replaced in the meantime
+void releaseSlot(SharedSlot& slot, uint64_t version)
+{
+	uint64_t state = slot.state.load(std::memory_order_acquire);
+	while (getVersion(state) == version && (state & SHARED_REF_MASK) > 0)
+	{
+		if (slot.state.compare_exchange_weak(state, state - 1, std::memory_order_acq_rel))
+		{
+			return;
+		}
+	}
+}
+
+void unmapSharedFrame(void* info)
+{
+	auto* mapping = static_cast<SharedMapping*>(info);
+	munmap(mapping->addr, mapping->size);
+	releaseSlot(mapping->index->slots[mapping->slot], mapping->version);
+	delete mapping;
+}
+
+// Maps the entry of a slot the caller holds a reference to
+FramePtr mapSharedFrame(SharedIndex* index, size_t slot, uint64_t version, uint64_t key)
+{
+	int fd = shm_open(getEntryName(slot, version - 1).c_str(), O_RDONLY | O_CLOEXEC, 0);
+	if (fd < 0)
+	{
+		return nullptr;
+	}
+
+	struct stat st;
+	void* addr = MAP_FAILED;
+	if (fstat(fd, &st) == 0 && st.st_size > off_t(SHARED_FRAME_HEADER_SIZE))
+	{
+		addr = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	}
+	close(fd);
+	if (addr == MAP_FAILED)
+	{
+		return nullptr;
+	}
+
+	SharedFrameHeader header;
+	std::memcpy(&header, addr, sizeof(header));
+
+	auto format = static_cast<QImage::Format>(header.format);
+	if (!std::equal(header.magic, header.magic + sizeof(header.magic), SHARED_FRAME_MAGIC)
+		|| header.key != key
+		|| (format != QImage::Format_RGB32 && format != QImage::Format_ARGB32_Premultiplied)
+		|| header.bytesPerLine < header.width * 4
+		|| uint64_t(st.st_size) != SHARED_FRAME_HEADER_SIZE + uint64_t(header.bytesPerLine) * header.height)
+	{
+		munmap(addr, st.st_size);
+		return nullptr;
+	}
+
+	// The reference is handed to the image, which gives it back along with the mapping
+	auto* mapping = new SharedMapping{ index, slot, version, addr, size_t(st.st_size) };
+	const uchar* pixels = static_cast<const uchar*>(addr) + SHARED_FRAME_HEADER_SIZE;
+	QImage image(pixels, header.width, header.height, header.bytesPerLine, format, unmapSharedFrame, mapping);
+	if (image.isNull())
+	{
+		munmap(addr, st.st_size);
+		delete mapping;
+		return nullptr;
+	}
+
+	auto frame = std::make_shared<Frame>();
+	frame->image = std::move(image);
+	frame->reduced = header.reduced != 0;
+	frame->orientation = fromExifOrientation(header.orientation);
+	return frame;
+}
+
+FramePtr loadSharedFrame(const fs_str_t& path, const QSize& targetSize)
+{
+	SharedIndex* index = getSharedIndex();
+	if (!index || targetSize.isEmpty())
+	{
+		return nullptr;
+	}
+
+	uint64_t key = getFrameKey(path, targetSize);
+	if (key == 0)
+	{
+		return nullptr;
+	}
+
+	for (size_t i = 0; i < SHARED_PROBE_LENGTH; ++i)
+	{
+		size_t slot = (key + i) % SHARED_SLOT_COUNT;
+		SharedSlot& entry = index->slots[slot];
+
+		// Only a published entry (even version) whose version doesn't change under us counts
+		uint64_t version = getVersion(entry.state.load(std::memory_order_acquire));
+		if (version == 0 || version % 2 != 0 || entry.key.load(std::memory_order_relaxed) != key)
+		{
+			continue;
+		}
+		if (!acquireSlot(entry, version))
+		{
+			continue;
+		}
+
+		if (FramePtr frame = mapSharedFrame(index, slot, version, key))
+		{
+			entry.lastUse.store(++index->clock, std::memory_order_relaxed);
+			return frame;
+		}
+		releaseSlot(entry, version);
+	}
+	return nullptr;
+}
+
+// Locks a slot of the key's probe window for writing: an empty one if there is
+// one, else a dead writer's, else the least recently used entry (unmapped ones
+// first). Returns the new (odd) version, or 0 if the key is already there or
+// every slot is being written.
+uint64_t lockSlotForKey(SharedIndex* index, uint64_t key, size_t& lockedSlot)
+{
+	uint64_t now = getWallClockMs();
+
+	// Ranked by kind (empty, dead writer, unmapped, mapped), then by last use
+	size_t bestSlot = SHARED_SLOT_COUNT;
+	uint64_t bestState = 0;
+	std::pair<int, uint64_t> bestRank;
+	for (size_t i = 0; i < SHARED_PROBE_LENGTH; ++i)
+	{
+		size_t slot = (key + i) % SHARED_SLOT_COUNT;
+		SharedSlot& entry = index->slots[slot];
+		uint64_t state = entry.state.load(std::memory_order_acquire);
+		uint64_t version = getVersion(state);
+		uint64_t entryKey = entry.key.load(std::memory_order_relaxed);
+
+		std::pair<int, uint64_t> rank;
+		if (version % 2 != 0)
+		{
+			if (now < entry.lockedAtMs.load(std::memory_order_relaxed) + SHARED_STALE_LOCK_MS)
+			{
+				continue;
+			}
+			rank = { 1, 0 };
+		}
+		else if (entryKey == key)
+		{
+			return 0;
+		}
+		else if (entryKey == 0)
+		{
+			rank = { 0, 0 };
+		}
+		else
+		{
+			rank = { (state & SHARED_REF_MASK) != 0 ? 3 : 2, entry.lastUse.load(std::memory_order_relaxed) };
+		}
+
+		if (bestSlot == SHARED_SLOT_COUNT || rank < bestRank)
+		{
+			bestSlot = slot;
+			bestState = state;
+			bestRank = rank;
+		}
+	}
+
+	if (bestSlot == SHARED_SLOT_COUNT)
+	{
+		return 0;
+	}
+
+	SharedSlot& entry = index->slots[bestSlot];
+	uint64_t oldVersion = getVersion(bestState);
+	uint64_t newVersion = oldVersion % 2 != 0 ? oldVersion + 2 : oldVersion + 1;
+	if (!entry.state.compare_exchange_strong(bestState, newVersion << SHARED_REF_BITS, std::memory_order_acq_rel))
+	{
+		return 0;
+	}
+	entry.lockedAtMs.store(now, std::memory_order_relaxed);
+
+	// Whoever still maps the previous entry keeps it: unlinking only drops the name
+	if (oldVersion % 2 != 0)
+	{
+		shm_unlink(getEntryName(bestSlot, oldVersion).c_str());
+	}
+	else if (entry.key.load(std::memory_order_relaxed) != 0)
+	{
+		shm_unlink(getEntryName(bestSlot, oldVersion - 1).c_str());
+		index->totalBytes -= entry.bytes.load(std::memory_order_relaxed);
+	}
+	entry.key.store(0, std::memory_order_relaxed);
+	entry.bytes.store(0, std::memory_order_relaxed);
+
+	lockedSlot = bestSlot;
+	return newVersion;
+}
+
+// Publishes the slot, with an entry of 'bytes' under 'key' or (key 0) empty
+void unlockSlot(SharedIndex* index, size_t slot, uint64_t writeVersion, uint64_t key, uint64_t bytes)
+{
+	SharedSlot& entry = index->slots[slot];
+	entry.key.store(key, std::memory_order_relaxed);
+	entry.bytes.store(bytes, std::memory_order_relaxed);
+	entry.lastUse.store(++index->clock, std::memory_order_relaxed);
+	index->totalBytes += bytes;
+	entry.state.store((writeVersion + 1) << SHARED_REF_BITS, std::memory_order_release);
+}
+
+bool writeSharedEntry(const std::string& name, uint64_t key, const Frame& frame)
+{
+	const QImage& image = frame.image;
+	size_t size = SHARED_FRAME_HEADER_SIZE + image.sizeInBytes();
+
+	int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+	if (fd < 0)
+	{
+		return false;
+	}
+
+	void* addr = MAP_FAILED;
+	if (ftruncate(fd, size) == 0)
+	{
+		addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	}
+	close(fd);
+	if (addr == MAP_FAILED)
+	{
+		shm_unlink(name.c_str());
+		return false;
+	}
+
+	SharedFrameHeader header = {};
+	std::copy(SHARED_FRAME_MAGIC, SHARED_FRAME_MAGIC + sizeof(SHARED_FRAME_MAGIC), header.magic);
+	header.key = key;
+	header.width = image.width();
+	header.height = image.height();
+	header.bytesPerLine = image.bytesPerLine();
+	header.format = image.format();
+	header.reduced = frame.reduced;
+	header.orientation = toExifOrientation(frame.orientation);
+
+	std::memcpy(addr, &header, sizeof(header));
+	std::memcpy(static_cast<uint8_t*>(addr) + SHARED_FRAME_HEADER_SIZE, image.constBits(), image.sizeInBytes());
+	munmap(addr, size);
+	return true;
+}
+
+// Drops least recently used entries, unmapped ones first, until the index fits the budget
+void enforceSharedBudget(SharedIndex* index, uint64_t budget)
+{
+	for (size_t round = 0; round < SHARED_SLOT_COUNT && index->totalBytes.load() > budget; ++round)
+	{
+		size_t victim = SHARED_SLOT_COUNT;
+		uint64_t victimState = 0;
+		std::pair<bool, uint64_t> victimRank;
+		for (size_t slot = 0; slot < SHARED_SLOT_COUNT; ++slot)
+		{
+			SharedSlot& entry = index->slots[slot];
+			uint64_t state = entry.state.load(std::memory_order_acquire);
+			if (getVersion(state) % 2 != 0 || entry.key.load(std::memory_order_relaxed) == 0)
+			{
+				continue;
+			}
+
+			std::pair<bool, uint64_t> rank((state & SHARED_REF_MASK) != 0, entry.lastUse.load(std::memory_order_relaxed));
+			if (victim == SHARED_SLOT_COUNT || rank < victimRank)
+			{
+				victim = slot;
+				victimState = state;
+				victimRank = rank;
+			}
+		}
+
+		if (victim == SHARED_SLOT_COUNT)
+		{
+			return;
+		}
+
+		SharedSlot& entry = index->slots[victim];
+		uint64_t version = getVersion(victimState);
+		if (!entry.state.compare_exchange_strong(victimState, (version + 1) << SHARED_REF_BITS, std::memory_order_acq_rel))
+		{
+			continue;
+		}
+		entry.lockedAtMs.store(getWallClockMs(), std::memory_order_relaxed);
+
+		shm_unlink(getEntryName(victim, version - 1).c_str());
+		index->totalBytes -= entry.bytes.load(std::memory_order_relaxed);
+		unlockSlot(index, victim, version + 1, 0, 0);
+	}
+}
+
+void storeSharedFrame(SharedIndex* index, const fs_str_t& path, const QSize& targetSize, FramePtr frame)
+{
+	uint64_t key = getFrameKey(path, targetSize);
+	uint64_t bytes = SHARED_FRAME_HEADER_SIZE + frame->image.sizeInBytes();
+	if (key == 0 || bytes > getSharedBudget())
+	{
+		return;
+	}
+
+	size_t slot = 0;
+	uint64_t writeVersion = lockSlotForKey(index, key, slot);
+	if (writeVersion == 0)
+	{
+		return;
+	}
+
+	if (writeSharedEntry(getEntryName(slot, writeVersion), key, *frame))
+	{
+		unlockSlot(index, slot, writeVersion, key, bytes);
+		enforceSharedBudget(index, getSharedBudget());
+	}
+	else
+	{
+		unlockSlot(index, slot, writeVersion, 0, 0);
+	}
+}
+
+void publishSharedFrame(const fs_str_t& path, const QSize& targetSize, FramePtr frame)
+{
+	SharedIndex* index = getSharedIndex();
+	if (!index || targetSize.isEmpty() || !frame || frame->preview)
+	{
+		return;
+	}
+
+	// The copy into shared memory shouldn't hold up whoever decoded the frame
+	std::thread([index, path, targetSize, frame = std::move(frame)]()
+	{
+		storeSharedFrame(index, path, targetSize, frame);
+	}).detach();
+}
@@ -2,7 +2,14 @@
 
 #if defined(__linux__) || defined(__APPLE__) || defined(IGAL_PLATFORM_OVERRIDE_LINUX) || defined(IGAL_PLATFORM_OVERRIDE_MACOS)
 
+#include <cerrno>
+
+#include <fcntl.h>
 #include <limits.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
 #include <unistd.h>
 
 fs_str_t getExeDir()
@@ -12,4 +19,82 @@ fs_str_t getExeDir()
 	return fs_str_t(buff);
 }
 
+void setBackgroundThreadPriority()
+{
+#if defined(__linux__)
+	// Both are per-thread on Linux and carried over to forked children
+	sched_param param = {};
+	sched_setscheduler(0, SCHED_IDLE, &param);
+	setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), 19);
+#endif
+}
+
+void setBackgroundProcessPriority()
+{
+	setpriority(PRIO_PROCESS, 0, 19);
+
+#if defined(__linux__)
+	// Idle I/O class: disk time only goes to us when nobody else wants it.
+	// Threads and child processes started afterwards inherit it.
+	const int IOPRIO_CLASS_IDLE = 3;
+	const int IOPRIO_CLASS_SHIFT = 13;
+	syscall(SYS_ioprio_set, 1 /* IOPRIO_WHO_PROCESS */, 0, IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT);
+#endif
+}
+
+bool writeAll(int fd, const void* data, size_t size)
+{
+	const char* p = static_cast<const char*>(data);
+	while (size > 0)
+	{
+		ssize_t written = write(fd, p, size);
+		if (written < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			return false;
+		}
+		p += written;
+		size -= static_cast<size_t>(written);
+	}
+	return true;
+}
+
+bool replaceFileContents(const fs_str_t& path, const void* data, size_t size)
+{
+	// A new file would split the links or change the owner. Truncating the original
+	// instead would fault any mapping of it (decodes, readahead): refuse.
+	struct stat st;
+	if (stat(path.c_str(), &st) != 0 || st.st_nlink != 1)
+	{
+		return false;
+	}
+
+	fs_str_t tempPath = path + ".igal-XXXXXX";
+	int fd = mkstemp(tempPath.data());
+	if (fd < 0)
+	{
+		return false;
+	}
+
+	// Unprivileged processes may only keep the owner if it is them already
+	bool sameOwner = fchown(fd, st.st_uid, st.st_gid) == 0 || (st.st_uid == geteuid() && st.st_gid == getegid());
+	bool written = writeAll(fd, data, size) && fchmod(fd, st.st_mode & 07777) == 0 && fsync(fd) == 0;
+	close(fd);
+	if (!written)
+	{
+		unlink(tempPath.c_str());
+		return false;
+	}
+
+	if (!sameOwner || rename(tempPath.c_str(), path.c_str()) != 0)
+	{
+		unlink(tempPath.c_str());
+		return false;
+	}
+	return true;
+}
+
 #endif
\ No newline at end of file
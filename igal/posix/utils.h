@@ -6,4 +6,16 @@
 
 fs_str_t getExeDir();
 
+// Lowers the calling thread to idle priority. Processes it starts inherit the priority.
+void setBackgroundThreadPriority();
+
+// Lowers CPU and I/O priority of the whole process. Call before starting any thread.
+void setBackgroundProcessPriority();
+
+// Replaces the contents of an existing file through a uniquely named temp file
+// with the same permissions and owner, renamed over it. Fails for files with
+// other hard links or whose owner can't be copied: the file is never truncated,
+// as it may be mapped meanwhile.
+bool replaceFileContents(const fs_str_t& path, const void* data, size_t size);
+
 #endif
\ No newline at end of file
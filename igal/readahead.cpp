@@ -0,0 +1,140 @@
+#include "readahead.h"
+
+#include <algorithm>
+#include <chrono>
+
+#include "mappedfile.h"
+
+const uint64_t READAHEAD_MIN_BUDGET = 16ull * 1024 * 1024;
+const uint64_t READAHEAD_MAX_BUDGET = 512ull * 1024 * 1024;
+const double READAHEAD_SECONDS = 3.0;
+const double READAHEAD_INITIAL_THROUGHPUT = 50.0 * 1024 * 1024;
+const size_t READAHEAD_CHUNK_SIZE = 1024 * 1024;
+const size_t READAHEAD_RECENT_COUNT = 64;
+
+// Reads faster than this are page cache hits and say nothing about the storage
+const double READAHEAD_MIN_SAMPLE_SECONDS = 0.002;
+
+Readahead::Readahead()
+    : throughput(READAHEAD_INITIAL_THROUGHPUT)
+{
+    worker = std::thread([this]() { run(); });
+}
+
+Readahead::~Readahead()
+{
+    {
+        std::lock_guard lock(mux);
+        stopping = true;
+        ++generation;
+    }
+    cv.notify_one();
+    worker.join();
+}
+
+void Readahead::schedule(std::vector<fs_str_t> paths)
+{
+    {
+        std::lock_guard lock(mux);
+        pending = std::move(paths);
+        hasPending = true;
+        ++generation;
+    }
+    cv.notify_one();
+}
+
+uint64_t Readahead::getBudget() const
+{
+    auto budget = static_cast<uint64_t>(throughput.load() * READAHEAD_SECONDS);
+    return std::clamp(budget, READAHEAD_MIN_BUDGET, READAHEAD_MAX_BUDGET);
+}
+
+void Readahead::run()
+{
+    while (true)
+    {
+        std::vector<fs_str_t> paths;
+        uint64_t currentGeneration;
+        {
+            std::unique_lock lock(mux);
+            cv.wait(lock, [&]() { return hasPending || stopping; });
+            if (stopping)
+            {
+                return;
+            }
+
+            paths = std::move(pending);
+            hasPending = false;
+            currentGeneration = generation;
+        }
+
+        uint64_t remainingBudget = getBudget();
+        for (const auto& path : paths)
+        {
+            if (remainingBudget == 0 || generation != currentGeneration)
+            {
+                break;
+            }
+            if (!isRecentlyWarmed(path))
+            {
+                warmFile(path, remainingBudget, currentGeneration);
+            }
+        }
+    }
+}
+
+void Readahead::warmFile(const fs_str_t& path, uint64_t& remainingBudget, uint64_t fileGeneration)
+{
+    MappedFile file(path);
+    if (!file.isValid())
+    {
+        return;
+    }
+
+    size_t length = static_cast<size_t>(std::min<uint64_t>(file.size(), remainingBudget));
+    file.adviseWillNeed(0, length);
+
+    // Touch every page, so the data also lands in the page cache where the hint is ignored (FUSE, SMB)
+    auto start = std::chrono::steady_clock::now();
+    volatile uint8_t sink = 0;
+    for (size_t chunk = 0; chunk < length; chunk += READAHEAD_CHUNK_SIZE)
+    {
+        if (generation != fileGeneration)
+        {
+            return;
+        }
+
+        size_t chunkEnd = std::min(length, chunk + READAHEAD_CHUNK_SIZE);
+        for (size_t offset = chunk; offset < chunkEnd; offset += 4096)
+        {
+            sink = sink + file.data()[offset];
+        }
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    remainingBudget -= length;
+    addThroughputSample(length, elapsed.count());
+
+    recentlyWarmed.push_back(path);
+    if (recentlyWarmed.size() > READAHEAD_RECENT_COUNT)
+    {
+        recentlyWarmed.pop_front();
+    }
+}
+
+void Readahead::addThroughputSample(uint64_t bytes, double seconds)
+{
+    if (seconds < READAHEAD_MIN_SAMPLE_SECONDS)
+    {
+        return;
+    }
+
+    // Exponential moving average, so the budget follows the storage currently being browsed
+    double sample = bytes / seconds;
+    throughput = throughput * 0.7 + sample * 0.3;
+}
+
+bool Readahead::isRecentlyWarmed(const fs_str_t& path) const
+{
+    return std::find(recentlyWarmed.begin(), recentlyWarmed.end(), path) != recentlyWarmed.end();
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "defs.h"
+
+// Background I/O tier: pulls upcoming files into the OS page cache ahead of the
+// decode window. How many bytes are read ahead follows the measured storage throughput.
+class Readahead
+{
+public:
+    Readahead();
+    ~Readahead();
+
+    // Replaces any pending work. Files are read in order until the byte budget is spent.
+    void schedule(std::vector<fs_str_t> paths);
+
+    uint64_t getBudget() const;
+
+private:
+    void run();
+    void warmFile(const fs_str_t& path, uint64_t& remainingBudget, uint64_t generation);
+    void addThroughputSample(uint64_t bytes, double seconds);
+    bool isRecentlyWarmed(const fs_str_t& path) const;
+
+    std::thread worker;
+    std::mutex mux;
+    std::condition_variable cv;
+    std::vector<fs_str_t> pending;
+    bool hasPending = false;
+    bool stopping = false;
+
+    std::atomic<uint64_t> generation = 0;
+    std::atomic<double> throughput;
+
+    std::deque<fs_str_t> recentlyWarmed;
+};
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <QtCore/qsize.h>
+
+#include "defs.h"
+#include "frame.h"
+
+// Opt-in memory tier shared by every igal process of the user on this machine:
+// several windows on the same directories decode an image once and map the
+// very same pixels. Frames are keyed by path, inode, mtime, ctime, file size
+// and target size, so even a rewrite that keeps the mtime and size misses, and
+// live in POSIX shared memory behind a small lock-free index. Each entry
+// counts the processes mapping it; once the budget of IGAL_SHARED_CACHE_MB
+// (unset or 0: disabled) is exceeded, the least recently used entries nobody
+// maps are dropped first. Not available on Windows.
+
+// Null if no process published the frame (or the shared cache is disabled)
+FramePtr loadSharedFrame(const fs_str_t& path, const QSize& targetSize);
+
+// Copies a freshly decoded frame into shared memory, in the background
+void publishSharedFrame(const fs_str_t& path, const QSize& targetSize, FramePtr frame);
@@ -0,0 +1,68 @@
+#include "singleinstance.h"
+
+#include <QtNetwork/qlocalsocket.h>
+
+#include "fsutils.h"
+
+const int INSTANCE_CONNECT_TIMEOUT_MS = 250;
+const int INSTANCE_WRITE_TIMEOUT_MS = 1000;
+
+QString getInstanceServerName()
+{
+    // One resident instance per user
+    QString user = qEnvironmentVariable("USER", qEnvironmentVariable("USERNAME"));
+    return "igal-" + user;
+}
+
+bool sendToRunningInstance(const fs_str_t& target)
+{
+    QLocalSocket socket;
+    socket.connectToServer(getInstanceServerName());
+    if (!socket.waitForConnected(INSTANCE_CONNECT_TIMEOUT_MS))
+    {
+        return false;
+    }
+
+    socket.write(fsstrToQstring(target).toUtf8() + '\n');
+    bool ok = socket.waitForBytesWritten(INSTANCE_WRITE_TIMEOUT_MS);
+    socket.disconnectFromServer();
+
+    return ok;
+}
+
+InstanceServer::InstanceServer(std::function<void(const fs_str_t&)> onTarget)
+    : onTarget(std::move(onTarget))
+    , server(std::make_unique<QLocalServer>())
+{
+    // Nobody answered on this name, so any socket file left behind is stale
+    QLocalServer::removeServer(getInstanceServerName());
+
+    server->setSocketOptions(QLocalServer::UserAccessOption);
+    server->listen(getInstanceServerName());
+
+    QObject::connect(server.get(), &QLocalServer::newConnection, [this]() { acceptConnection(); });
+}
+
+bool InstanceServer::isListening() const
+{
+    return server->isListening();
+}
+
+void InstanceServer::acceptConnection()
+{
+    while (QLocalSocket* socket = server->nextPendingConnection())
+    {
+        QObject::connect(socket, &QLocalSocket::disconnected, socket, &QObject::deleteLater);
+        QObject::connect(socket, &QLocalSocket::readyRead, socket, [this, socket]()
+        {
+            while (socket->canReadLine())
+            {
+                QString line = QString::fromUtf8(socket->readLine()).trimmed();
+                if (!line.isEmpty())
+                {
+                    onTarget(qstringToFsstr(line));
+                }
+            }
+        });
+    }
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <QtNetwork/qlocalserver.h>
+
+#include <functional>
+#include <memory>
+
+#include "defs.h"
+
+// Hands 'target' over to a running resident instance. Returns false if there is none.
+bool sendToRunningInstance(const fs_str_t& target);
+
+// Accepts targets handed over by later launches (see sendToRunningInstance)
+class InstanceServer
+{
+public:
+    explicit InstanceServer(std::function<void(const fs_str_t&)> onTarget);
+
+    bool isListening() const;
+
+private:
+    void acceptConnection();
+
+    std::function<void(const fs_str_t&)> onTarget;
+    std::unique_ptr<QLocalServer> server;
+};
@@ -0,0 +1,239 @@
+#include "transcode.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+
+#include "cachestore.h"
+#include "fsutils.h"
+#include "mediatypes.h"
+
+const fs_str_t OS_VID_FMT = FSSTR(".mp4");
+
+fs_str_t genFfmpegCmd(const fs_str_t& source, const fs_str_t& target)
+{
+    return FSSTR("ffmpeg -y -i \"") + source + FSSTR("\" -preset veryfast -pix_fmt yuv420p \"") + target + FSSTR("\"");
+}
+
+fs_str_t transcodeToCache(const fs_str_t& target, const fs_str_t& cachedPath, bool background)
+{
+    // Transcode to a private temp file: concurrent instances never see a partial video
+    auto temp_path = getCacheTempPath(cachedPath);
+    fs_str_t ffmpeg_cmd_mp4 = genFfmpegCmd(target, temp_path);
+    if (fs_system(ffmpeg_cmd_mp4, background) != 0)
+    {
+        std::error_code ec;
+        std::filesystem::remove(temp_path, ec);
+        return fs_str_t();
+    }
+
+    if (!commitCacheFile(temp_path, cachedPath))
+    {
+        return fs_str_t();
+    }
+    return cachedPath;
+}
+
+// A transcode running for a cache entry, and whether it runs at idle priority
+struct InFlightTranscode
+{
+    std::shared_future<fs_str_t> result;
+    bool background = false;
+};
+
+std::mutex inFlightMux;
+std::unordered_map<fs_str_t, InFlightTranscode> inFlight;
+
+fs_str_t getCachedAnimatedPath(const fs_str_t& target, bool background)
+{
+    auto key = getContentKey(target);
+    if (key.empty())
+    {
+        return fs_str_t();
+    }
+
+    auto cached_path = getCachePath(key, OS_VID_FMT);
+    if (useCacheFile(cached_path))
+    {
+        return cached_path;
+    }
+
+    // A run at the same or a higher priority is waited for. One the background queue
+    // started at idle priority could take arbitrarily long under load, so opening the
+    // animation runs its own (they commit the same content) and later callers wait for that.
+    std::promise<fs_str_t> promise;
+    std::shared_future<fs_str_t> running;
+    {
+        std::lock_guard lock(inFlightMux);
+        auto it = inFlight.find(cached_path);
+        if (it != inFlight.end() && (background || !it->second.background))
+        {
+            running = it->second.result;
+        }
+        else
+        {
+            inFlight[cached_path] = { promise.get_future().share(), background };
+        }
+    }
+
+    if (running.valid())
+    {
+        return running.get();
+    }
+
+    auto result = transcodeToCache(target, cached_path, background);
+    promise.set_value(result);
+
+    // A background run may have been overtaken: the entry is the foreground one's then
+    std::lock_guard lock(inFlightMux);
+    auto it = inFlight.find(cached_path);
+    if (it != inFlight.end() && it->second.background == background)
+    {
+        inFlight.erase(it);
+    }
+    return result;
+}
+
+struct TranscodeQueue::State
+{
+    std::mutex mux;
+    std::condition_variable cv;
+    bool stopping = false;
+
+    // Pending animations as (item index, path)
+    std::vector<std::pair<size_t, fs_str_t>> pending;
+    size_t focus = 0;
+    int direction = 1;
+
+    size_t generation = 0;
+    size_t done = 0;
+    size_t total = 0;
+
+    ProgressCallback onProgress;
+};
+
+// Index into 'pending' of the item to transcode next: the closest one to the
+// focus, where items behind the navigation direction count as twice as far
+size_t getNextPending(const std::vector<std::pair<size_t, fs_str_t>>& pending, size_t focus, int direction)
+{
+    size_t best = 0;
+    size_t bestCost = SIZE_MAX;
+    for (size_t i = 0; i < pending.size(); ++i)
+    {
+        size_t idx = pending[i].first;
+        bool ahead = direction >= 0 ? idx >= focus : idx <= focus;
+        size_t distance = idx >= focus ? idx - focus : focus - idx;
+        size_t cost = ahead ? distance : distance * 2;
+        if (cost < bestCost)
+        {
+            best = i;
+            bestCost = cost;
+        }
+    }
+    return best;
+}
+
+TranscodeQueue::TranscodeQueue(ProgressCallback onProgress)
+    : state(std::make_shared<State>())
+{
+    state->onProgress = std::move(onProgress);
+
+    // Leave half of the cores to decoding and playback
+    size_t workerCount = std::max(1u, std::thread::hardware_concurrency() / 2);
+    for (size_t i = 0; i < workerCount; ++i)
+    {
+        std::thread(run, state).detach();
+    }
+}
+
+TranscodeQueue::~TranscodeQueue()
+{
+    {
+        std::lock_guard lock(state->mux);
+        state->stopping = true;
+        state->pending.clear();
+    }
+    state->cv.notify_all();
+}
+
+void TranscodeQueue::setItems(const ItemList& items)
+{
+    std::vector<std::pair<size_t, fs_str_t>> candidates;
+    for (size_t i = 0; i < items.size(); ++i)
+    {
+        if (animationExtensions.count(getTargetExtension(fs_str_t(items.getName(i)))))
+        {
+            candidates.emplace_back(i, items.getPath(i));
+        }
+    }
+
+    {
+        std::lock_guard lock(state->mux);
+        state->pending = std::move(candidates);
+        state->total = state->pending.size();
+        state->done = 0;
+        ++state->generation;
+    }
+    state->cv.notify_all();
+}
+
+void TranscodeQueue::setFocus(size_t index, int direction)
+{
+    std::lock_guard lock(state->mux);
+    state->focus = index;
+    state->direction = direction;
+}
+
+void TranscodeQueue::run(std::shared_ptr<State> state)
+{
+    setBackgroundThreadPriority();
+
+    while (true)
+    {
+        fs_str_t path;
+        size_t generation;
+        {
+            std::unique_lock lock(state->mux);
+            state->cv.wait(lock, [&]() { return !state->pending.empty() || state->stopping; });
+            if (state->stopping)
+            {
+                return;
+            }
+
+            size_t next = getNextPending(state->pending, state->focus, state->direction);
+            path = std::move(state->pending[next].second);
+            state->pending[next] = std::move(state->pending.back());
+            state->pending.pop_back();
+            generation = state->generation;
+        }
+
+        // Still PNGs share the extension with APNGs, and finished entries only need a lookup
+        bool transcoded = false;
+        if (isAnimation(path))
+        {
+            auto key = getContentKey(path);
+            if (!key.empty() && !useCacheFile(getCachePath(key, OS_VID_FMT)))
+            {
+                getCachedAnimatedPath(path, true);
+                transcoded = true;
+            }
+        }
+
+        std::lock_guard lock(state->mux);
+        if (state->stopping || generation != state->generation)
+        {
+            continue;
+        }
+        ++state->done;
+        if (transcoded && state->onProgress)
+        {
+            state->onProgress(state->done, state->total);
+        }
+    }
+}
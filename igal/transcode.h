@@ -0,0 +1,42 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "defs.h"
+#include "itemlist.h"
+
+extern const fs_str_t OS_VID_FMT;
+
+// Path of the cached video transcode of an animation, transcoding it first if needed.
+// Concurrent calls for the same content share a single ffmpeg run, except that a
+// foreground call never waits for a background one. May run ffmpeg: call from a
+// worker thread. Empty on failure.
+fs_str_t getCachedAnimatedPath(const fs_str_t& target, bool background = false);
+
+// Pre-transcodes the animations of the item list into the cache on idle-priority
+// workers, nearest to the current item first (items ahead of the navigation
+// direction are preferred), so playing them back never waits for ffmpeg.
+class TranscodeQueue
+{
+public:
+    // Called from a worker after every transcode that actually ran
+    using ProgressCallback = std::function<void(size_t done, size_t total)>;
+
+    explicit TranscodeQueue(ProgressCallback onProgress);
+    ~TranscodeQueue();
+
+    // Replaces the pending work with the animations in 'items'
+    void setItems(const ItemList& items);
+
+    void setFocus(size_t index, int direction);
+
+private:
+    struct State;
+
+    static void run(std::shared_ptr<State> state);
+
+    // Shared with the workers, which are detached: a running ffmpeg is never waited on at exit
+    std::shared_ptr<State> state;
+};
@@ -0,0 +1,165 @@
+#include "videoframes.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <memory>
+#include <sstream>
+#include <string>
+
+#include "fsutils.h"
+
+bool VideoStreamInfo::isValid() const
+{
+    return !size.isEmpty() && fps > 0 && frameCount > 0;
+}
+
+qint64 VideoStreamInfo::getFramePositionMs(qint64 frame) const
+{
+    return std::llround(frame * 1000 / fps);
+}
+
+qint64 VideoStreamInfo::getFrameAt(qint64 positionMs) const
+{
+    return std::clamp<qint64>(static_cast<qint64>(std::floor(positionMs * fps / 1000 + 0.5)), 0, frameCount - 1);
+}
+
+// "30000/1001" or "25"
+double parseFrameRate(const std::string& text)
+{
+    char* end = nullptr;
+    double num = std::strtod(text.c_str(), &end);
+    double den = (end && *end == '/') ? std::strtod(end + 1, nullptr) : 1.0;
+    return den > 0 ? num / den : 0;
+}
+
+VideoStreamInfo probeVideoStream(const fs_str_t& videoPath)
+{
+    // One line for the stream (width,height,rate), one for the container (duration)
+    auto output = fs_system_output(
+        FSSTR("ffprobe -v error -select_streams v:0 -show_entries stream=width,height,r_frame_rate:format=duration -of csv=p=0 \"")
+        + videoPath + FSSTR("\""));
+
+    VideoStreamInfo info;
+    std::istringstream iss(output);
+    std::string streamLine;
+    std::string durationLine;
+    if (!std::getline(iss, streamLine) || !std::getline(iss, durationLine))
+    {
+        return info;
+    }
+
+    std::istringstream fields(streamLine);
+    std::string width;
+    std::string height;
+    std::string rate;
+    if (!std::getline(fields, width, ',') || !std::getline(fields, height, ',') || !std::getline(fields, rate, ','))
+    {
+        return info;
+    }
+
+    info.size = QSize(std::atoi(width.c_str()), std::atoi(height.c_str()));
+    info.fps = parseFrameRate(rate);
+    info.frameCount = std::llround(std::strtod(durationLine.c_str(), nullptr) * info.fps);
+    return info;
+}
+
+void releaseFrameBatch(void* info)
+{
+    delete static_cast<std::shared_ptr<const std::string>*>(info);
+}
+
+std::vector<QImage> decodeVideoFrames(const fs_str_t& videoPath, const VideoStreamInfo& info, qint64 first, int count, const QSize& frameSize)
+{
+    std::vector<QImage> result;
+    if (!info.isValid() || frameSize.isEmpty() || count <= 0)
+    {
+        return result;
+    }
+
+    // A quarter frame early, so that rounding can't skip the first frame
+    double startSeconds = std::max(0.0, (first - 0.25) / info.fps);
+    std::string w = std::to_string(frameSize.width());
+    std::string h = std::to_string(frameSize.height());
+    std::string filter = "scale=w=" + w + ":h=" + h + ":force_original_aspect_ratio=decrease"
+        + ",pad=" + w + ":" + h + ":(ow-iw)/2:(oh-ih)/2";
+
+    // BGRA is the byte order of QImage::Format_RGB32 on little-endian machines
+    auto output = std::make_shared<const std::string>(fs_system_output(
+        FSSTR("ffmpeg -v error -ss ") + qstringToFsstr(QString::number(startSeconds, 'f', 6))
+        + FSSTR(" -i \"") + videoPath
+        + FSSTR("\" -an -sn -frames:v ") + qstringToFsstr(QString::number(count))
+        + FSSTR(" -vf \"") + qstringToFsstr(QString::fromStdString(filter))
+        + FSSTR("\" -pix_fmt bgra -f rawvideo -")));
+
+    // The frames read straight from the batch, which lives as long as any of them does
+    size_t frameBytes = static_cast<size_t>(frameSize.width()) * frameSize.height() * 4;
+    size_t frameCount = output->size() / frameBytes;
+    for (size_t i = 0; i < frameCount; ++i)
+    {
+        const uchar* pixels = reinterpret_cast<const uchar*>(output->data()) + i * frameBytes;
+        result.emplace_back(pixels, frameSize.width(), frameSize.height(), frameSize.width() * 4, QImage::Format_RGB32,
+            releaseFrameBatch, new std::shared_ptr<const std::string>(output));
+    }
+    return result;
+}
+
+void VideoFrameRing::reset(size_t capacity)
+{
+    slots.assign(capacity, QImage());
+    first = 0;
+    count = 0;
+}
+
+bool VideoFrameRing::contains(qint64 frame) const
+{
+    return frame >= first && frame < getEnd();
+}
+
+const QImage& VideoFrameRing::get(qint64 frame) const
+{
+    return slots[static_cast<size_t>(frame) % slots.size()];
+}
+
+void VideoFrameRing::insert(qint64 start, std::vector<QImage> frames)
+{
+    qint64 end = start + static_cast<qint64>(frames.size());
+    if (slots.empty() || frames.empty() || start < 0)
+    {
+        return;
+    }
+
+    if (count == 0 || end < first || start > getEnd())
+    {
+        first = start;
+        count = 0;
+    }
+
+    // At or past the front of the run: overwrite, then grow forward, dropping the oldest frames
+    for (qint64 frame = std::max(start, first); frame < end; ++frame)
+    {
+        slot(frame) = std::move(frames[static_cast<size_t>(frame - start)]);
+        if (frame >= getEnd())
+        {
+            ++count;
+            if (count > slots.size())
+            {
+                ++first;
+                --count;
+            }
+        }
+    }
+
+    // Before it: grow backward, dropping the newest frames
+    for (qint64 frame = std::min(end, first) - 1; frame >= start; --frame)
+    {
+        if (count == slots.size())
+        {
+            slot(getEnd() - 1) = QImage();
+            --count;
+        }
+        slot(frame) = std::move(frames[static_cast<size_t>(frame - start)]);
+        --first;
+        ++count;
+    }
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <QtCore/qsize.h>
+
+#include <QtGui/qimage.h>
+
+#include <vector>
+
+#include "defs.h"
+
+// What frame stepping needs to know about the first video stream
+struct VideoStreamInfo
+{
+    QSize size;
+    double fps = 0;
+    qint64 frameCount = 0;
+
+    bool isValid() const;
+
+    qint64 getFramePositionMs(qint64 frame) const;
+
+    // Frame shown at the position
+    qint64 getFrameAt(qint64 positionMs) const;
+};
+
+// Runs ffprobe: call from a worker thread
+VideoStreamInfo probeVideoStream(const fs_str_t& videoPath);
+
+// Decodes up to 'count' consecutive frames, starting with frame 'first', fitted
+// into 'frameSize' (letterboxed). ffmpeg seeks to the keyframe before 'first' and
+// decodes from there, so a run costs a single GOP decode however many frames it
+// spans. Runs ffmpeg: call from a worker thread.
+std::vector<QImage> decodeVideoFrames(const fs_str_t& videoPath, const VideoStreamInfo& info, qint64 first, int count, const QSize& frameSize);
+
+// Decoded frames around the playhead: a contiguous run of frame numbers held in a
+// fixed number of slots. Extending the run at one end drops frames at the other.
+class VideoFrameRing
+{
+public:
+    // Drops every frame
+    void reset(size_t capacity);
+
+    size_t getCapacity() const { return slots.size(); }
+
+    bool contains(qint64 frame) const;
+    const QImage& get(qint64 frame) const;
+
+    // Held run is [getFirst(), getEnd())
+    qint64 getFirst() const { return first; }
+    qint64 getEnd() const { return first + static_cast<qint64>(count); }
+
+    // Adds frames 'start', 'start + 1'... A run that neither overlaps nor touches
+    // the held one replaces it.
+    void insert(qint64 start, std::vector<QImage> frames);
+
+private:
+    QImage& slot(qint64 frame) { return slots[static_cast<size_t>(frame) % slots.size()]; }
+
+    std::vector<QImage> slots;
+    qint64 first = 0;
+    size_t count = 0;
+};
@@ -0,0 +1,249 @@
+#include "videopreview.h"
+
+#include <QtCore/qstring.h>
+
+#include <QtGui/qpainter.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include "cachestore.h"
+#include "fsutils.h"
+
+const int PREVIEW_MAX_FRAMES = 100;
+const int PREVIEW_COLUMNS = 10;
+const int PREVIEW_FRAME_WIDTH = 160;
+const int PREVIEW_JPEG_QUALITY = 75;
+
+// ffmpeg runs seeking to a frame each: few enough not to disturb the video playing meanwhile
+const size_t PREVIEW_PARALLEL_SEEKS = 4;
+
+// Renamed whenever the sprite contents change meaning (these hold exact frames, not the nearest keyframes)
+const fs_str_t PREVIEW_INDEX_EXT = FSSTR(".preview2");
+const fs_str_t PREVIEW_SPRITE_EXT = FSSTR(".preview2.jpg");
+
+bool VideoPreview::isValid() const
+{
+    return !sprite.isNull() && columns > 0 && frameCount > 0 && intervalMs > 0 && !frameSize.isEmpty();
+}
+
+QImage VideoPreview::getFrame(qint64 positionMs) const
+{
+    if (!isValid())
+    {
+        return QImage();
+    }
+
+    qint64 idx = std::clamp<qint64>((positionMs + intervalMs / 2) / intervalMs, 0, frameCount - 1);
+    int x = static_cast<int>(idx % columns) * frameSize.width();
+    int y = static_cast<int>(idx / columns) * frameSize.height();
+
+    return sprite.copy(x, y, frameSize.width(), frameSize.height());
+}
+
+qint64 VideoPreview::snapToKeyframe(qint64 positionMs, qint64 toleranceMs) const
+{
+    auto it = std::lower_bound(keyframesMs.begin(), keyframesMs.end(), positionMs);
+
+    qint64 result = positionMs;
+    qint64 bestDistance = toleranceMs + 1;
+    if (it != keyframesMs.end() && *it - positionMs < bestDistance)
+    {
+        result = *it;
+        bestDistance = *it - positionMs;
+    }
+    if (it != keyframesMs.begin() && positionMs - *(it - 1) < bestDistance)
+    {
+        result = *(it - 1);
+    }
+    return result;
+}
+
+fs_str_t toFsstr(const std::string& ascii)
+{
+    return fs_str_t(ascii.begin(), ascii.end());
+}
+
+double probeVideoDuration(const fs_str_t& videoPath)
+{
+    auto output = fs_system_output(
+        FSSTR("ffprobe -v error -show_entries format=duration -of csv=p=0 \"") + videoPath + FSSTR("\""));
+
+    return std::strtod(output.c_str(), nullptr);
+}
+
+// Keyframe timestamps. The decoder drops every other frame unseen, and only keyframes are listed.
+std::vector<qint64> probeKeyframes(const fs_str_t& videoPath)
+{
+    auto output = fs_system_output(
+        FSSTR("ffprobe -v error -select_streams v:0 -skip_frame nokey -show_entries frame=best_effort_timestamp_time -of csv=p=0 \"")
+        + videoPath + FSSTR("\""));
+
+    std::vector<qint64> result;
+    std::istringstream iss(output);
+    std::string line;
+    while (std::getline(iss, line))
+    {
+        if (line.empty() || line[0] == 'N')
+        {
+            continue;
+        }
+        result.push_back(std::llround(std::strtod(line.c_str(), nullptr) * 1000));
+    }
+
+    std::sort(result.begin(), result.end());
+    return result;
+}
+
+// The frame shown at the position, scaled down. ffmpeg seeks to the keyframe before it and
+// decodes up to the exact frame, so long GOPs cost time but never move the preview off.
+QImage decodeSpriteFrame(const fs_str_t& videoPath, qint64 positionMs)
+{
+    auto output = fs_system_output(
+        FSSTR("ffmpeg -v error -ss ") + qstringToFsstr(QString::number(positionMs / 1000.0, 'f', 3))
+        + FSSTR(" -i \"") + videoPath
+        + FSSTR("\" -an -sn -frames:v 1 -vf scale=") + toFsstr(std::to_string(PREVIEW_FRAME_WIDTH))
+        + FSSTR(":-2 -c:v bmp -f image2pipe -"));
+
+    return QImage::fromData(reinterpret_cast<const uchar*>(output.data()), static_cast<int>(output.size()), "BMP");
+}
+
+bool buildSprite(const fs_str_t& videoPath, const fs_str_t& spritePath, int frameCount, qint64 intervalMs)
+{
+    std::vector<QImage> frames(frameCount);
+    std::atomic<int> next = 0;
+
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < std::min<size_t>(PREVIEW_PARALLEL_SEEKS, frameCount); ++t)
+    {
+        threads.emplace_back([&]()
+        {
+            for (int i = next++; i < frameCount; i = next++)
+            {
+                frames[i] = decodeSpriteFrame(videoPath, i * intervalMs);
+            }
+        });
+    }
+    for (auto& t : threads)
+    {
+        t.join();
+    }
+
+    // Tiles that couldn't be decoded (past the last frame, say) stay black
+    auto sized = std::find_if(frames.begin(), frames.end(), [](const QImage& frame) { return !frame.isNull(); });
+    if (sized == frames.end())
+    {
+        return false;
+    }
+    QSize frameSize = sized->size();
+
+    int rows = (frameCount + PREVIEW_COLUMNS - 1) / PREVIEW_COLUMNS;
+    QImage sprite(frameSize.width() * PREVIEW_COLUMNS, frameSize.height() * rows, QImage::Format_RGB32);
+    sprite.fill(Qt::black);
+    {
+        QPainter painter(&sprite);
+        for (int i = 0; i < frameCount; ++i)
+        {
+            QRect tile(QPoint((i % PREVIEW_COLUMNS) * frameSize.width(), (i / PREVIEW_COLUMNS) * frameSize.height()), frameSize);
+            painter.drawImage(tile, frames[i]);
+        }
+    }
+
+    fs_str_t tempPath = getCacheTempPath(spritePath);
+    if (!sprite.save(fsstrToQstring(tempPath), "JPG", PREVIEW_JPEG_QUALITY))
+    {
+        std::error_code ec;
+        std::filesystem::remove(tempPath, ec);
+        return false;
+    }
+    return commitCacheFile(tempPath, spritePath);
+}
+
+bool writePreviewIndex(const fs_str_t& indexPath, const VideoPreview& preview)
+{
+    fs_str_t tempPath = getCacheTempPath(indexPath);
+    {
+        std::ofstream ofs(tempPath);
+        ofs << preview.columns << ' ' << preview.frameCount << ' ' << preview.intervalMs << '\n';
+        for (qint64 keyframe : preview.keyframesMs)
+        {
+            ofs << keyframe << ' ';
+        }
+        ofs << '\n';
+
+        if (!ofs)
+        {
+            return false;
+        }
+    }
+
+    return commitCacheFile(tempPath, indexPath);
+}
+
+bool readPreviewIndex(const fs_str_t& indexPath, VideoPreview& preview)
+{
+    std::ifstream ifs(indexPath);
+    if (!(ifs >> preview.columns >> preview.frameCount >> preview.intervalMs))
+    {
+        return false;
+    }
+
+    qint64 keyframe;
+    while (ifs >> keyframe)
+    {
+        preview.keyframesMs.push_back(keyframe);
+    }
+    return true;
+}
+
+std::shared_ptr<VideoPreview> loadVideoPreview(const fs_str_t& videoPath)
+{
+    auto preview = std::make_shared<VideoPreview>();
+
+    auto key = getContentKey(videoPath);
+    if (key.empty())
+    {
+        return preview;
+    }
+
+    fs_str_t indexPath = getCachePath(key, PREVIEW_INDEX_EXT);
+    fs_str_t spritePath = getCachePath(key, PREVIEW_SPRITE_EXT);
+
+    if (!useCacheFile(indexPath)
+        || !useCacheFile(spritePath)
+        || !readPreviewIndex(indexPath, *preview))
+    {
+        double duration = probeVideoDuration(videoPath);
+        if (duration <= 0)
+        {
+            return preview;
+        }
+
+        preview = std::make_shared<VideoPreview>();
+        preview->columns = PREVIEW_COLUMNS;
+        preview->frameCount = std::clamp(static_cast<int>(duration), 1, PREVIEW_MAX_FRAMES);
+        preview->intervalMs = std::llround(duration * 1000 / preview->frameCount);
+        preview->keyframesMs = probeKeyframes(videoPath);
+
+        if (!buildSprite(videoPath, spritePath, preview->frameCount, preview->intervalMs)
+            || !writePreviewIndex(indexPath, *preview))
+        {
+            return preview;
+        }
+    }
+
+    preview->sprite = QImage(fsstrToQstring(spritePath));
+    if (!preview->sprite.isNull())
+    {
+        int rows = (preview->frameCount + preview->columns - 1) / preview->columns;
+        preview->frameSize = QSize(preview->sprite.width() / preview->columns, preview->sprite.height() / rows);
+    }
+    return preview;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <QtCore/qsize.h>
+
+#include <QtGui/qimage.h>
+
+#include <memory>
+#include <vector>
+
+#include "defs.h"
+
+// Seek preview data for a video: the keyframe timestamps and a sprite sheet of
+// low-resolution frames sampled at a fixed interval
+struct VideoPreview
+{
+    std::vector<qint64> keyframesMs;
+
+    QImage sprite;
+    int columns = 0;
+    int frameCount = 0;
+    qint64 intervalMs = 0;
+    QSize frameSize;
+
+    bool isValid() const;
+
+    // Sprite frame closest to the position, or a null image
+    QImage getFrame(qint64 positionMs) const;
+
+    // Nearest keyframe within 'toleranceMs' of the position, or the position itself
+    qint64 snapToKeyframe(qint64 positionMs, qint64 toleranceMs) const;
+};
+
+// Loads the preview of 'videoPath' from the cache store, building it first if missing.
+// Building runs ffprobe/ffmpeg and takes a while: call from a worker thread.
+std::shared_ptr<VideoPreview> loadVideoPreview(const fs_str_t& videoPath);
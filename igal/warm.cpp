@@ -0,0 +1,198 @@
+#include "warm.h"
+
+#include <QtCore/qelapsedtimer.h>
+
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "fsutils.h"
+#include "imagehash.h"
+#include "itemcolumns.h"
+#include "itemlist.h"
+#include "mediatypes.h"
+#include "pixelcache.h"
+#include "transcode.h"
+#include "videopreview.h"
+
+struct WarmSummary
+{
+    size_t directories = 0;
+    size_t images = 0;
+    size_t displayFrames = 0;
+    size_t animations = 0;
+    size_t videos = 0;
+    size_t failures = 0;
+};
+
+std::vector<fs_str_t> collectDirectories(const fs_str_t& root, bool recursive)
+{
+    namespace stdfs = std::filesystem;
+    std::vector<fs_str_t> result = { root };
+    if (!recursive)
+    {
+        return result;
+    }
+
+    std::error_code ec;
+    auto options = stdfs::directory_options::skip_permission_denied;
+    for (auto it = stdfs::recursive_directory_iterator(root, options, ec); !ec && it != stdfs::recursive_directory_iterator(); it.increment(ec))
+    {
+        std::error_code typeEc;
+        if (it->is_directory(typeEc))
+        {
+            result.push_back(it->path().native());
+        }
+    }
+    return result;
+}
+
+// Transcodes animations and builds seek previews, which are ffmpeg runs
+void runFfmpegJobs(const std::vector<fs_str_t>& animations, const std::vector<fs_str_t>& videos, WarmSummary& summary)
+{
+    size_t jobCount = animations.size() + videos.size();
+    std::atomic<size_t> next = 0;
+    std::atomic<size_t> failures = 0;
+
+    auto work = [&]()
+    {
+        for (size_t i = next++; i < jobCount; i = next++)
+        {
+            bool ok = false;
+            if (i < animations.size())
+            {
+                // Animations are played back from their transcode, which gets a seek preview too
+                auto videoPath = getCachedAnimatedPath(animations[i]);
+                ok = !videoPath.empty() && loadVideoPreview(videoPath)->isValid();
+            }
+            else
+            {
+                ok = loadVideoPreview(videos[i - animations.size()])->isValid();
+            }
+
+            if (!ok)
+            {
+                ++failures;
+            }
+        }
+    };
+
+    // ffmpeg is multithreaded itself: one run per two cores keeps every core busy
+    size_t threadCount = std::clamp<size_t>(std::thread::hardware_concurrency() / 2, 1, std::max<size_t>(jobCount, 1));
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < threadCount; ++t)
+    {
+        threads.emplace_back(work);
+    }
+    for (auto& t : threads)
+    {
+        t.join();
+    }
+
+    summary.animations += animations.size();
+    summary.videos += videos.size();
+    summary.failures += failures;
+}
+
+// Decodes still images at the display size, which fills the pixel cache for the slow ones
+void prebuildDisplayFrames(const std::vector<fs_str_t>& images, const QSize& displaySize, WarmSummary& summary)
+{
+    std::atomic<size_t> next = 0;
+    std::atomic<size_t> failures = 0;
+
+    auto work = [&]()
+    {
+        for (size_t i = next++; i < images.size(); i = next++)
+        {
+            if (!prebuildCachedFrame(images[i], displaySize))
+            {
+                ++failures;
+            }
+        }
+    };
+
+    size_t threadCount = std::clamp<size_t>(std::thread::hardware_concurrency(), 1, std::max<size_t>(images.size(), 1));
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < threadCount; ++t)
+    {
+        threads.emplace_back(work);
+    }
+    for (auto& t : threads)
+    {
+        t.join();
+    }
+
+    summary.displayFrames += images.size() - failures;
+    summary.failures += failures;
+}
+
+void warmDirectory(const fs_str_t& dir, const QSize& displaySize, WarmSummary& summary)
+{
+    ItemList items;
+    ItemColumns columns;
+    scanMediaItems(dir, items, columns);
+    if (items.empty())
+    {
+        return;
+    }
+
+    auto hashes = computeImageHashes(items, columns, nullptr);
+    size_t imageCount = std::count_if(hashes.begin(), hashes.end(), [](const auto& hash) { return hash.has_value(); });
+
+    std::vector<fs_str_t> stills;
+    std::vector<fs_str_t> animations;
+    std::vector<fs_str_t> videos;
+    for (size_t i = 0; i < items.size(); ++i)
+    {
+        auto path = items.getPath(i);
+        if (isAnimation(path))
+        {
+            animations.push_back(std::move(path));
+        }
+        else if (isImage(path))
+        {
+            stills.push_back(std::move(path));
+        }
+        else if (isVideo(path))
+        {
+            videos.push_back(std::move(path));
+        }
+    }
+    prebuildDisplayFrames(stills, displaySize, summary);
+    runFfmpegJobs(animations, videos, summary);
+
+    ++summary.directories;
+    summary.images += imageCount;
+
+    std::cout << qPrintable(fsstrToQstring(dir)) << ": "
+              << imageCount << " images, "
+              << animations.size() << " animations, "
+              << videos.size() << " videos\n";
+}
+
+int runWarmMode(const fs_str_t& root, bool recursive, const QSize& displaySize)
+{
+    setBackgroundProcessPriority();
+
+    QElapsedTimer timer;
+    timer.start();
+
+    WarmSummary summary;
+    for (const auto& dir : collectDirectories(root, recursive))
+    {
+        warmDirectory(dir, displaySize, summary);
+    }
+
+    std::cout << "Warmed " << summary.directories << " directories: "
+              << summary.images << " images hashed, "
+              << summary.displayFrames << " images decoded at " << displaySize.width() << "x" << displaySize.height() << ", "
+              << summary.animations << " animations transcoded, "
+              << summary.videos << " video previews built, "
+              << summary.failures << " failures, in "
+              << timer.elapsed() / 1000.0 << " s\n";
+
+    return summary.failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <QtCore/qsize.h>
+
+#include "defs.h"
+
+// Headless cache warming (igal --warm <dir>): builds the perceptual hash index,
+// the pixel cache entries of images decoded for 'displaySize' device pixels, the
+// animation transcodes and the video seek previews of a directory, or of every
+// directory below it when 'recursive' is set, then prints a summary.
+// Runs at background CPU/I/O priority. Returns the process exit code.
+int runWarmMode(const fs_str_t& root, bool recursive, const QSize& displaySize);
@@ -0,0 +1,27 @@
+#include "../dirscan.h"
+
+#include <filesystem>
+
+std::vector<ScanEntry> scanDirectory(const fs_str_t& dir, const std::function<bool(const fs_str_t&)>& filter)
+{
+    namespace stdfs = std::filesystem;
+    std::vector<ScanEntry> result;
+
+    // FindNextFile already returns type, size and times with each entry; directory_entry
+    // caches them, so no per-file metadata call is issued here
+    std::error_code ec;
+    for (const auto& f : stdfs::directory_iterator(dir.empty() ? L"." : dir, ec))
+    {
+        if (!filter(f.path().filename().wstring()) || !f.is_regular_file(ec))
+        {
+            continue;
+        }
+
+        result.push_back({
+            f.path().filename().wstring(),
+            static_cast<long long>(f.last_write_time(ec).time_since_epoch().count()),
+            static_cast<uint64_t>(f.file_size(ec))
+        });
+    }
+    return result;
+}
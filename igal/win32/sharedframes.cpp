@@ -0,0 +1,12 @@
+#include "../sharedframes.h"
+
+// No shared tier on Windows: every process keeps its own frames
+
+FramePtr loadSharedFrame(const fs_str_t& path, const QSize& targetSize)
+{
+    return nullptr;
+}
+
+void publishSharedFrame(const fs_str_t& path, const QSize& targetSize, FramePtr frame)
+{
+}
@@ -3,8 +3,9 @@
 #include <Windows.h>
 
 #include <filesystem>
+#include <string>
 
-void execProc(const fs_str_t& cmdLine)
+int execProc(const fs_str_t& cmdLine, bool background)
 {
     auto cmdCopy = cmdLine + L"\0";
 
@@ -14,22 +15,95 @@ void execProc(const fs_str_t& cmdLine)
     ZeroMemory(&startupInfo, sizeof(STARTUPINFO));
     ZeroMemory(&procInfo, sizeof(PROCESS_INFORMATION));
 
-    CreateProcessW(
+    BOOL started = CreateProcessW(
         NULL,
         cmdCopy.data(),
         NULL,
         NULL,
         TRUE,
-        CREATE_NO_WINDOW,
+        CREATE_NO_WINDOW | (background ? IDLE_PRIORITY_CLASS : 0),
         NULL,
         NULL,
         &startupInfo,
         &procInfo
     );
 
+    if (!started)
+    {
+        return -1;
+    }
+
+    DWORD exitCode = 0;
     WaitForSingleObject(procInfo.hProcess, INFINITE);
+    GetExitCodeProcess(procInfo.hProcess, &exitCode);
     CloseHandle(procInfo.hProcess);
     CloseHandle(procInfo.hThread);
+
+    return static_cast<int>(exitCode);
+}
+
+std::string execProcOutput(const fs_str_t& cmdLine)
+{
+    std::string result;
+    auto cmdCopy = cmdLine + L"\0";
+
+    SECURITY_ATTRIBUTES secAttr;
+    ZeroMemory(&secAttr, sizeof(SECURITY_ATTRIBUTES));
+    secAttr.nLength = sizeof(SECURITY_ATTRIBUTES);
+    secAttr.bInheritHandle = TRUE;
+
+    HANDLE readPipe = NULL;
+    HANDLE writePipe = NULL;
+    if (!CreatePipe(&readPipe, &writePipe, &secAttr, 0))
+    {
+        return result;
+    }
+    SetHandleInformation(readPipe, HANDLE_FLAG_INHERIT, 0);
+
+    STARTUPINFOW startupInfo;
+    PROCESS_INFORMATION procInfo;
+
+    ZeroMemory(&startupInfo, sizeof(STARTUPINFO));
+    ZeroMemory(&procInfo, sizeof(PROCESS_INFORMATION));
+
+    startupInfo.cb = sizeof(STARTUPINFOW);
+    startupInfo.dwFlags = STARTF_USESTDHANDLES;
+    startupInfo.hStdOutput = writePipe;
+    startupInfo.hStdError = GetStdHandle(STD_ERROR_HANDLE);
+    startupInfo.hStdInput = GetStdHandle(STD_INPUT_HANDLE);
+
+    BOOL started = CreateProcessW(
+        NULL,
+        cmdCopy.data(),
+        NULL,
+        NULL,
+        TRUE,
+        CREATE_NO_WINDOW,
+        NULL,
+        NULL,
+        &startupInfo,
+        &procInfo
+    );
+
+    // Only the child may hold the write end, or ReadFile never sees EOF
+    CloseHandle(writePipe);
+
+    if (started)
+    {
+        char buff[4096];
+        DWORD count = 0;
+        while (ReadFile(readPipe, buff, sizeof(buff), &count, NULL) && count > 0)
+        {
+            result.append(buff, count);
+        }
+
+        WaitForSingleObject(procInfo.hProcess, INFINITE);
+        CloseHandle(procInfo.hProcess);
+        CloseHandle(procInfo.hThread);
+    }
+
+    CloseHandle(readPipe);
+    return result;
 }
 
 fs_str_t getExeDir()
@@ -40,4 +114,52 @@ fs_str_t getExeDir()
     
     fs_str_t exePath(path);
     return std::filesystem::path(exePath).parent_path().wstring();
-}
\ No newline at end of file
+}
+
+void setBackgroundThreadPriority()
+{
+    SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_BEGIN);
+}
+
+void setBackgroundProcessPriority()
+{
+    SetPriorityClass(GetCurrentProcess(), PROCESS_MODE_BACKGROUND_BEGIN);
+}
+
+const size_t MAX_WRITE_CHUNK = 1 << 30;
+
+bool replaceFileContents(const fs_str_t& path, const void* data, size_t size)
+{
+    // CREATE_NEW fails rather than reuse a name another writer holds
+    HANDLE file = INVALID_HANDLE_VALUE;
+    fs_str_t tempPath;
+    for (unsigned attempt = 0; attempt < 100 && file == INVALID_HANDLE_VALUE; ++attempt)
+    {
+        tempPath = path + L".igal-" + std::to_wstring(GetCurrentProcessId()) + L"-" + std::to_wstring(GetTickCount64() + attempt);
+        file = CreateFileW(tempPath.c_str(), GENERIC_WRITE, 0, NULL, CREATE_NEW, FILE_ATTRIBUTE_NORMAL, NULL);
+    }
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+
+    const char* p = static_cast<const char*>(data);
+    bool written = true;
+    while (written && size > 0)
+    {
+        DWORD count = 0;
+        DWORD chunk = static_cast<DWORD>(size < MAX_WRITE_CHUNK ? size : MAX_WRITE_CHUNK);
+        written = WriteFile(file, p, chunk, &count, NULL) && count == chunk;
+        p += count;
+        size -= count;
+    }
+    written = written && FlushFileBuffers(file);
+    CloseHandle(file);
+
+    if (!written || !ReplaceFileW(path.c_str(), tempPath.c_str(), NULL, REPLACEFILE_IGNORE_MERGE_ERRORS, NULL, NULL))
+    {
+        DeleteFileW(tempPath.c_str());
+        return false;
+    }
+    return true;
+}
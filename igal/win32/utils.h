@@ -4,7 +4,21 @@
 
 #if defined(WIN32) || defined(_WIN32)
 
-void execProc(const fs_str_t& cmdLine);
+#include <string>
+
+// 'background' runs the process in the idle priority class
+int execProc(const fs_str_t& cmdLine, bool background = false);
+std::string execProcOutput(const fs_str_t& cmdLine);
 fs_str_t getExeDir();
 
+// Lowers the calling thread to background priority (CPU and I/O)
+void setBackgroundThreadPriority();
+
+// Lowers CPU and I/O priority of the whole process
+void setBackgroundProcessPriority();
+
+// Replaces the contents of an existing file through a uniquely named temp file,
+// swapped in by ReplaceFileW so that the attributes and ACLs of the original are kept
+bool replaceFileContents(const fs_str_t& path, const void* data, size_t size);
+
 #endif
\ No newline at end of file